@@ -29,8 +29,16 @@
 #include <cstring>
 #include <sstream>
 #include <stdlib.h>
+#include <pthread.h>
 using namespace std;
 
+struct ackerman_thread_args
+{
+	Ackerman* am; // each thread recurses on its own Ackerman (own seed and counter)
+	int n, m;
+	int result;
+};
+
 string Ackerman::get_time_diff(struct timeval* tp1, struct timeval* tp2)
 { /* Returns a string containing the difference, in seconds and micro seconds, between two timevals. */
 	long sec = tp2->tv_sec - tp1->tv_sec;
@@ -45,15 +53,29 @@ string Ackerman::get_time_diff(struct timeval* tp1, struct timeval* tp2)
 	return ss.str();
 }
 
-void Ackerman::test(BuddyAllocator* _ba)
+void* Ackerman::thread_function(void* arg)
+{ // runs one Ackerman computation on a worker thread
+	struct ackerman_thread_args* arguments = (struct ackerman_thread_args*) arg;
+	arguments->result = arguments->am->Recurse(arguments->n, arguments->m);
+	pthread_exit(NULL);
+}
+
+void Ackerman::test(BuddyAllocator* _ba, int _threads, int _n, int _m)
 { /* This is function repeatedly asks the user for the two parameters "n" and "m" to pass to the ackerman function, and invokes the function.
 	 Before and after the invocation of the ackerman function, the value of the wallclock is taken, and the elapsed time for the computation
      of the ackerman function is output.
+	 With _threads > 1 the same computation is run concurrently on that many threads sharing the allocator (which must then be
+	 created with BA_CONCURRENT), and the aggregate allocate/free throughput is reported as well.
+	 If _n and _m are given, that single computation is run without prompting (for scripted runs).
   */
 	ba = _ba;
+	if (_n > 0 && _m > 0)
+	{
+		run(_n, _m, _threads);
+		return;
+	}
 	while (true)
 	{
-		this->num_allocations = 0;
 		cout << "=====================================================================" << endl;
 		cout << "Please enter parameters n (<=3) and m (<=8) to ackerman function" << endl;
 		cout << "Enter 0 for either n or m in order to exit." << endl
@@ -66,16 +88,63 @@ void Ackerman::test(BuddyAllocator* _ba)
 		cin >> m;
 		if (!n || !m)
 			break;
-		struct timeval tp_start, tp_end; /* Used to compute elapsed time. */
-		gettimeofday(&tp_start, 0);		 // start timer
-		int result = Recurse(n, m);		 // compute ackerman value
-		gettimeofday(&tp_end, 0);		 // stop timer
-
-		cout << "Ackerman(" << n << ", " << m << "): " << result << endl;
-		cout << "Time taken: " << get_time_diff(&tp_start, &tp_end) << endl;
-		cout << "Number of allocate/free cycles: " << this->num_allocations << endl
-			 << endl;
+		run(n, m, _threads);
+	}
+}
+
+void Ackerman::run(int n, int m, int _threads)
+{ // Computes Ackerman(n, m) once (on _threads threads if more than one) and prints the time taken
+	if (_threads > 1)
+	{
+		run_threaded(n, m, _threads);
+		return;
+	}
+
+	this->num_allocations = 0;
+	struct timeval tp_start, tp_end; /* Used to compute elapsed time. */
+	gettimeofday(&tp_start, 0);		 // start timer
+	int result = Recurse(n, m);		 // compute ackerman value
+	gettimeofday(&tp_end, 0);		 // stop timer
+
+	cout << "Ackerman(" << n << ", " << m << "): " << result << endl;
+	cout << "Time taken: " << get_time_diff(&tp_start, &tp_end) << endl;
+	cout << "Number of allocate/free cycles: " << this->num_allocations << endl
+		 << endl;
+}
+
+void Ackerman::run_threaded(int n, int m, int _threads)
+{ // Multi-threaded version of run(): every thread computes Ackerman(n, m) against the shared allocator
+	pthread_t threads[_threads];
+	Ackerman workers[_threads];
+	struct ackerman_thread_args args[_threads];
+
+	struct timeval tp_start, tp_end; /* Used to compute elapsed time. */
+	gettimeofday(&tp_start, 0);		 // start timer
+	for (int i = 0; i < _threads; i++)
+	{
+		workers[i].ba = ba;
+		workers[i].num_allocations = 0;
+		workers[i].seed = i + 1;
+		args[i].am = &workers[i];
+		args[i].n = n;
+		args[i].m = m;
+		pthread_create(&threads[i], NULL, thread_function, (void*) &args[i]);
+	}
+
+	unsigned int total_allocations = 0;
+	for (int i = 0; i < _threads; i++)
+	{
+		pthread_join(threads[i], NULL);
+		total_allocations += workers[i].num_allocations;
 	}
+	gettimeofday(&tp_end, 0);		 // stop timer
+
+	double elapsed = (tp_end.tv_sec - tp_start.tv_sec) + (tp_end.tv_usec - tp_start.tv_usec) / 1e6;
+	cout << "Ackerman(" << n << ", " << m << "): " << args[0].result << " on " << _threads << " threads" << endl;
+	cout << "Time taken: " << get_time_diff(&tp_start, &tp_end) << endl;
+	cout << "Number of allocate/free cycles: " << total_allocations << endl;
+	cout << "Throughput: " << (long) (total_allocations / elapsed) << " allocate/free cycles per second" << endl
+		 << endl;
 }
 
 int Ackerman::Recurse(int a, int b)
@@ -84,7 +153,7 @@ int Ackerman::Recurse(int a, int b)
   */
 
 	/* The size "to_alloc" of the region to allocate is computed randomly: */
-	int to_alloc = ((2 << (rand() % 19)) * (rand() % 100)) / 100;
+	int to_alloc = ((2 << (rand_r(&seed) % 19)) * (rand_r(&seed) % 100)) / 100;
 	if (to_alloc < 4)
 		to_alloc = 4;
 
@@ -96,7 +165,7 @@ int Ackerman::Recurse(int a, int b)
 	{
 		// testing the allocated memory
 		// generate a random byte to fill the allocated block of memory
-		char c = rand() % 128;
+		char c = rand_r(&seed) % 128;
 		memset(mem, c, to_alloc * sizeof(char));
 
 		if (a == 0)
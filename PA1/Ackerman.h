@@ -17,10 +17,14 @@ class Ackerman
 {
     BuddyAllocator* ba;
     unsigned int num_allocations;
+    unsigned int seed = 1; // rand_r state, so concurrent Recurse calls do not share rand()'s lock
+    static void* thread_function(void* arg);
+    void run(int n, int m, int _threads);
+    void run_threaded(int n, int m, int _threads);
 public:
     int Recurse(int a, int b);
     string get_time_diff(struct timeval* tp1, struct timeval* tp2);
-    void test(BuddyAllocator* _ma);
+    void test(BuddyAllocator* _ma, int _threads = 1, int _n = 0, int _m = 0);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,557 @@
+/*
+    File: AllocBench.cpp
+
+    Non-interactive allocator benchmark. Replays fixed-seed alloc/free traces
+    against BuddyAllocator and the system malloc in the same run, so results can
+    be tracked across changes:
+
+        ackerman   the memtest workload, Ackerman(3, 6) with its random sizes
+        uniform    sizes uniform in [16, 4096], random lifetimes
+        powerlaw   Pareto-distributed sizes (mostly tiny, a few up to 1 MiB)
+        prodcons   FIFO lifetimes; one thread allocates, another frees
+
+    or a trace recorded with memtest -r / BUDDY_TRACE (-i <file>), which is
+    replayed on one thread in the order the operations were recorded.
+
+    For every trace and allocator it reports throughput (operations per second
+    of time spent inside alloc/free), p50/p99/p999 operation latency, peak RSS
+    growth and the fragmentation at that peak (1 - live requested bytes / RSS
+    growth). Output is a table, CSV (-f csv) or JSON (-f json).
+*/
+
+#include "BuddyAllocator.h"
+#include <algorithm>
+#include <malloc.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+enum TRACE_OP {OP_ALLOC, OP_FREE};
+
+#define NOT_REPLAYED 0xFFFFFFFFu // latency of a free skipped because its allocation failed
+
+struct TraceOp
+{
+	unsigned char op;
+	unsigned int slot; // allocation this operation refers to
+	size_t size;       // requested bytes (OP_ALLOC only)
+};
+
+struct Trace
+{
+	string name;
+	vector<TraceOp> ops;
+	unsigned int slots;  // number of distinct allocations
+	bool split;          // OP_ALLOCs replayed by one thread, OP_FREEs by another
+	unsigned int depth;  // how far a split replay's producer may run ahead of the consumer
+	size_t rejected;     // recorded allocations not replayed (0 bytes or larger than any block), counted as failed
+};
+
+struct Result
+{
+	string trace, allocator;
+	size_t ops, failed;
+	double ops_per_sec;
+	double p50, p99, p999; // ns
+	size_t peak_rss;       // bytes above the pre-run baseline
+	double fragmentation;  // at peak_rss
+};
+
+/*--------------------------------------------------------------------------*/
+/* ALLOCATORS UNDER TEST */
+/*--------------------------------------------------------------------------*/
+
+class Backend
+{ // An allocator under test; a fresh instance is created for every trace
+public:
+	virtual ~Backend() {}
+	virtual char* alloc(size_t _length) = 0;
+	virtual void free(char* _a) = 0;
+};
+
+class BuddyBackend : public Backend
+{
+	BuddyAllocator ba;
+public:
+	BuddyBackend(int _basic_block_size, size_t _total_length, int _options) : ba(_basic_block_size, _total_length, _options | BA_QUIET) {}
+	char* alloc(size_t _length) { return ba.alloc(_length); }
+	void free(char* _a) { ba.free(_a); }
+};
+
+class MallocBackend : public Backend
+{
+public:
+	char* alloc(size_t _length) { return (char*) ::malloc(_length); }
+	void free(char* _a) { ::free(_a); }
+};
+
+struct BackendSpec
+{
+	const char* name;
+	int options; // BuddyAllocator options, or -1 for malloc
+};
+
+static BackendSpec backends[] = {
+	{"buddy", BA_DEFAULT},
+	{"buddy-slab", BA_SLAB | BA_NO_HEADER},
+	{"buddy-lazy", BA_LAZY},
+	{"malloc", -1},
+};
+
+/*--------------------------------------------------------------------------*/
+/* TRACE GENERATION */
+/*--------------------------------------------------------------------------*/
+
+static int ackerman_record(Trace* trace, unsigned int* seed, int a, int b)
+{ // Records the allocations Ackerman::Recurse would make (same size distribution), in the same nesting
+	int to_alloc = ((2 << (rand_r(seed) % 19)) * (rand_r(seed) % 100)) / 100;
+	if (to_alloc < 4)
+		to_alloc = 4;
+
+	unsigned int slot = trace->slots++;
+	trace->ops.push_back({OP_ALLOC, slot, (unsigned int) to_alloc});
+
+	int result;
+	if (a == 0)
+		result = b + 1;
+	else if (b == 0)
+		result = ackerman_record(trace, seed, a - 1, 1);
+	else
+		result = ackerman_record(trace, seed, a - 1, ackerman_record(trace, seed, a, b - 1));
+
+	trace->ops.push_back({OP_FREE, slot, 0});
+	return result;
+}
+
+static void window_record(Trace* trace, unsigned int seed, size_t allocations, unsigned int window, unsigned int (*next_size)(unsigned int*))
+{ /* Keeps up to 'window' allocations live; each step frees a random live one (once the window is full) and makes a new one.
+     Whatever is still live at the end is freed so every trace returns the allocator to empty.
+  */
+	vector<unsigned int> live;
+	for (size_t i = 0; i < allocations; ++i)
+	{
+		if (live.size() >= window)
+		{
+			unsigned int victim = rand_r(&seed) % live.size();
+			trace->ops.push_back({OP_FREE, live[victim], 0});
+			live[victim] = live.back();
+			live.pop_back();
+		}
+		unsigned int slot = trace->slots++;
+		trace->ops.push_back({OP_ALLOC, slot, next_size(&seed)});
+		live.push_back(slot);
+	}
+	for (size_t i = 0; i < live.size(); ++i)
+		trace->ops.push_back({OP_FREE, live[i], 0});
+}
+
+static unsigned int uniform_size(unsigned int* seed)
+{
+	return 16 + rand_r(seed) % (4096 - 16 + 1);
+}
+
+static unsigned int powerlaw_size(unsigned int* seed)
+{ // Pareto with alpha = 1.2 and minimum 16 bytes, capped at 1 MiB
+	double u = (rand_r(seed) + 1.0) / ((double) RAND_MAX + 2.0);
+	double size = 16.0 * pow(u, -1.0 / 1.2);
+	return (size > (1 << 20)) ? (1 << 20) : (unsigned int) size;
+}
+
+static void prodcons_record(Trace* trace, unsigned int seed, size_t allocations, unsigned int depth)
+{ // Messages are allocated in order and freed in the same order once 'depth' of them are in flight
+	for (size_t i = 0; i < allocations; ++i)
+	{
+		if (i >= depth)
+			trace->ops.push_back({OP_FREE, (unsigned int) (i - depth), 0});
+		trace->ops.push_back({OP_ALLOC, trace->slots++, 64 + (unsigned int) rand_r(&seed) % 1024});
+	}
+	for (size_t i = (allocations > depth) ? allocations - depth : 0; i < allocations; ++i)
+		trace->ops.push_back({OP_FREE, (unsigned int) i, 0});
+}
+
+static Trace make_trace(const string& name, unsigned int seed, size_t allocations)
+{ // Builds one of the named traces; an empty trace is returned for unknown names
+	Trace trace;
+	trace.name = name;
+	trace.slots = 0;
+	trace.split = false;
+	trace.depth = 0;
+	trace.rejected = 0;
+	if (name == "ackerman")
+		ackerman_record(&trace, &seed, 3, 6);
+	else if (name == "uniform")
+		window_record(&trace, seed, allocations, 4096, uniform_size);
+	else if (name == "powerlaw")
+		window_record(&trace, seed, allocations, 1024, powerlaw_size);
+	else if (name == "prodcons")
+	{
+		prodcons_record(&trace, seed, allocations, 256);
+		trace.split = true;
+		trace.depth = 256;
+	}
+	return trace;
+}
+
+static bool load_recorded_trace(const char* path, Trace* trace)
+{ // Turns a recorded trace into trace operations; the allocation ids become the slots
+	vector<TraceRecord> records;
+	if (!load_trace(path, records))
+		return false;
+
+	trace->name = path;
+	trace->slots = 0;
+	trace->split = false;
+	trace->depth = 0;
+	trace->rejected = 0;
+	trace->ops.reserve(records.size());
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const TraceRecord& record = records[i];
+		if (record.op == TRACE_ALLOC && (record.size == 0 || record.size > MAX_BLOCK_SIZE))
+		{ // Not handed to the allocators; its free then finds nothing to free
+			++trace->rejected;
+			continue;
+		}
+		trace->ops.push_back({(unsigned char) (record.op == TRACE_ALLOC ? OP_ALLOC : OP_FREE), record.id, (size_t) record.size});
+		if (record.id >= trace->slots)
+			trace->slots = record.id + 1;
+	}
+	return true;
+}
+
+/*--------------------------------------------------------------------------*/
+/* REPLAY */
+/*--------------------------------------------------------------------------*/
+
+static long long now_ns()
+{ // Returns a monotonic timestamp in nanoseconds
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static size_t current_rss()
+{ // Returns the resident set size of the process in bytes
+	FILE* f = fopen("/proc/self/statm", "r");
+	unsigned long pages = 0, resident = 0;
+	if (f != NULL)
+	{
+		if (fscanf(f, "%lu %lu", &pages, &resident) != 2)
+			resident = 0;
+		fclose(f);
+	}
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void touch(char* mem, size_t length)
+{ // Writes one byte per page so the allocation shows up in the RSS
+	if (length == 0)
+		return; // malloc(0) may return a unique pointer, but it has no byte to write
+	for (size_t i = 0; i < length; i += 4096)
+		mem[i] = 1;
+	mem[length - 1] = 1;
+}
+
+struct Replay
+{
+	const Trace* trace;
+	Backend* backend;
+	vector<char*> ptrs;
+	vector<size_t> sizes;         // requested bytes per slot, so frees can update live_bytes
+	vector<unsigned int> latency; // ns per operation, indexed like trace->ops (NOT_REPLAYED if skipped)
+	size_t failed;
+	size_t live_bytes;            // requested bytes currently allocated
+	size_t baseline_rss, peak_rss;
+	double fragmentation;
+	size_t allocs_done;           // split replay handoff: allocations published by the producer
+	size_t frees_done;            // and frees completed by the consumer
+};
+
+static void sample(Replay* r)
+{ // Records the footprint, and the fragmentation if this is the largest footprint so far
+	size_t rss = current_rss();
+	size_t growth = (rss > r->baseline_rss) ? rss - r->baseline_rss : 0;
+	if (growth > r->peak_rss)
+	{
+		r->peak_rss = growth;
+		size_t live = __atomic_load_n(&r->live_bytes, __ATOMIC_RELAXED);
+		r->fragmentation = (live < growth) ? 1.0 - (double) live / growth : 0.0;
+	}
+}
+
+static void replay_range(Replay* r, int only_op, bool sampling)
+{ /* Replays the trace's operations, or only those of type only_op (when >= 0) while another thread replays the rest.
+     A split replay keeps the producer at most trace->depth frees ahead of the consumer, like a bounded queue would.
+  */
+	const vector<TraceOp>& ops = r->trace->ops;
+	size_t allocs = 0, frees_seen = 0, replayed = 0;
+	for (size_t i = 0; i < ops.size(); ++i)
+	{
+		const TraceOp& op = ops[i];
+		if (only_op >= 0 && op.op != only_op)
+		{
+			if (op.op == OP_FREE)
+				++frees_seen;
+			continue;
+		}
+
+		if (op.op == OP_ALLOC)
+		{
+			while (only_op >= 0 && __atomic_load_n(&r->frees_done, __ATOMIC_ACQUIRE) + r->trace->depth < frees_seen)
+				sched_yield();
+
+			long long start = now_ns();
+			char* mem = r->backend->alloc(op.size);
+			r->latency[i] = now_ns() - start;
+			if (mem == nullptr)
+				++r->failed;
+			else
+			{
+				touch(mem, op.size);
+				__atomic_fetch_add(&r->live_bytes, op.size, __ATOMIC_RELAXED);
+			}
+			r->ptrs[op.slot] = mem;
+			r->sizes[op.slot] = op.size;
+			__atomic_store_n(&r->allocs_done, ++allocs, __ATOMIC_RELEASE);
+		}
+		else
+		{
+			// The consumer must not free an allocation the producer has not published yet (slots are numbered in allocation order)
+			while (only_op >= 0 && __atomic_load_n(&r->allocs_done, __ATOMIC_ACQUIRE) <= op.slot)
+				sched_yield();
+
+			char* mem = r->ptrs[op.slot];
+			if (mem != nullptr)
+			{
+				long long start = now_ns();
+				r->backend->free(mem);
+				r->latency[i] = now_ns() - start;
+				r->ptrs[op.slot] = nullptr;
+				__atomic_fetch_sub(&r->live_bytes, r->sizes[op.slot], __ATOMIC_RELAXED);
+			}
+			__atomic_fetch_add(&r->frees_done, 1, __ATOMIC_RELEASE);
+		}
+
+		if (sampling && (++replayed & 1023) == 0)
+			sample(r);
+	}
+}
+
+static void* consumer_function(void* arg)
+{ // Frees, in trace order, the allocations made by the producer
+	replay_range((Replay*) arg, OP_FREE, false);
+	pthread_exit(NULL);
+}
+
+static double percentile(vector<unsigned int>& values, double p)
+{ // Returns the p-quantile of values (reorders the vector)
+	if (values.empty())
+		return 0;
+	size_t k = (size_t) (p * (values.size() - 1));
+	nth_element(values.begin(), values.begin() + k, values.end());
+	return values[k];
+}
+
+static Result run(const Trace& trace, const BackendSpec& spec, int basic_block_size, size_t total_length)
+{ // Replays one trace on a fresh instance of one allocator
+	Replay r;
+	r.trace = &trace;
+	r.ptrs.assign(trace.slots, nullptr);
+	r.sizes.assign(trace.slots, 0);
+	r.latency.assign(trace.ops.size(), NOT_REPLAYED);
+	r.failed = r.live_bytes = r.peak_rss = r.allocs_done = r.frees_done = 0;
+	r.fragmentation = 0;
+
+	// The allocator must be thread safe when the trace is replayed by two threads
+	if (spec.options < 0)
+		r.backend = new MallocBackend();
+	else
+		r.backend = new BuddyBackend(basic_block_size, total_length, spec.options | (trace.split ? BA_CONCURRENT : 0));
+	malloc_trim(0); // hand back what earlier runs left in malloc's heap so it does not hide this run's growth
+	r.baseline_rss = current_rss();
+
+	if (trace.split)
+	{
+		pthread_t consumer;
+		pthread_create(&consumer, NULL, consumer_function, (void*) &r);
+		replay_range(&r, OP_ALLOC, true);
+		pthread_join(consumer, NULL);
+	}
+	else
+		replay_range(&r, -1, true);
+	delete r.backend;
+
+	unsigned long long total_ns = 0;
+	vector<unsigned int> latencies;
+	latencies.reserve(trace.ops.size());
+	for (size_t i = 0; i < r.latency.size(); ++i)
+	{
+		if (r.latency[i] == NOT_REPLAYED)
+			continue;
+		total_ns += r.latency[i];
+		latencies.push_back(r.latency[i]);
+	}
+
+	Result result;
+	result.trace = trace.name;
+	result.allocator = spec.name;
+	result.ops = latencies.size();
+	result.failed = r.failed + trace.rejected;
+	result.ops_per_sec = total_ns ? latencies.size() / (total_ns / 1e9) : 0;
+	result.p50 = percentile(latencies, 0.50);
+	result.p99 = percentile(latencies, 0.99);
+	result.p999 = percentile(latencies, 0.999);
+	result.peak_rss = r.peak_rss;
+	result.fragmentation = r.fragmentation;
+	return result;
+}
+
+/*--------------------------------------------------------------------------*/
+/* OUTPUT */
+/*--------------------------------------------------------------------------*/
+
+static void print_results(const vector<Result>& results, const string& format)
+{ // Prints the results as a table, CSV or JSON
+	if (format == "csv")
+	{
+		printf("trace,allocator,ops,failed,ops_per_sec,p50_ns,p99_ns,p999_ns,peak_rss_bytes,fragmentation\n");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results[i];
+			printf("%s,%s,%zu,%zu,%.0f,%.0f,%.0f,%.0f,%zu,%.4f\n", r.trace.c_str(), r.allocator.c_str(), r.ops, r.failed,
+				r.ops_per_sec, r.p50, r.p99, r.p999, r.peak_rss, r.fragmentation);
+		}
+	}
+	else if (format == "json")
+	{
+		printf("[\n");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results[i];
+			printf("  {\"trace\": \"%s\", \"allocator\": \"%s\", \"ops\": %zu, \"failed\": %zu, \"ops_per_sec\": %.0f, "
+				"\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"peak_rss_bytes\": %zu, \"fragmentation\": %.4f}%s\n",
+				r.trace.c_str(), r.allocator.c_str(), r.ops, r.failed, r.ops_per_sec, r.p50, r.p99, r.p999, r.peak_rss,
+				r.fragmentation, (i + 1 < results.size()) ? "," : "");
+		}
+		printf("]\n");
+	}
+	else
+	{
+		printf("%10s %12s %10s %8s %14s %8s %8s %8s %12s %8s\n", "trace", "allocator", "ops", "failed", "ops/sec",
+			"p50 ns", "p99 ns", "p999 ns", "peak RSS KB", "frag");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results[i];
+			printf("%10s %12s %10zu %8zu %14.0f %8.0f %8.0f %8.0f %12zu %7.1f%%\n", r.trace.c_str(), r.allocator.c_str(),
+				r.ops, r.failed, r.ops_per_sec, r.p50, r.p99, r.p999, r.peak_rss / 1024, 100.0 * r.fragmentation);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int basic_block_size = 128;
+	size_t memory_length = 512 * 1024 * 1024;
+	size_t allocations = 200000;
+	unsigned int seed = 313;
+	string format = "table";
+	vector<string> traces = {"ackerman", "uniform", "powerlaw", "prodcons"};
+	const char* recorded = NULL; // replay this trace file instead of the synthetic traces
+	const char* only_backend = NULL;
+
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "b:s:n:r:f:t:i:a:")) != -1)
+	{ // While options were received from getopt
+		int n = atoi(optarg);
+		switch (opt)
+		{
+			case 'b': // If block size is specified
+				if (n <= (int) sizeof(BlockHeader))
+				{
+					printf("ERROR: Block size must be larger than a BlockHeader (%u bytes)!\n", (unsigned) sizeof(BlockHeader));
+					return 0;
+				}
+				basic_block_size = n;
+				break;
+			case 's': // If arena size is specified
+				if (optarg[0] == '-' || strtoull(optarg, NULL, 10) < 1)
+				{
+					printf("ERROR: Memory length must be strictly positive!\n");
+					return 0;
+				}
+				memory_length = strtoull(optarg, NULL, 10);
+				break;
+			case 'n': // If number of allocations per synthetic trace is specified
+				if (n < 1)
+				{
+					printf("ERROR: Number of allocations must be strictly positive!\n");
+					return 0;
+				}
+				allocations = n;
+				break;
+			case 'r': // If trace seed is specified
+				seed = strtoul(optarg, NULL, 10);
+				break;
+			case 'f': // If output format is specified
+				format = optarg;
+				if (format != "table" && format != "csv" && format != "json")
+				{
+					printf("ERROR: Output format must be table, csv or json!\n");
+					return 0;
+				}
+				break;
+			case 't': // If a single trace is selected
+				traces.assign(1, optarg);
+				break;
+			case 'i': // If a recorded trace should be replayed
+				recorded = optarg;
+				break;
+			case 'a': // If a single allocator is selected
+				only_backend = optarg;
+				break;
+			case '?': // If unknown, end the program (getopt produces its own error message)
+				return 0;
+		}
+	}
+
+	vector<Trace> runs;
+	if (recorded != NULL)
+	{
+		runs.resize(1);
+		if (!load_recorded_trace(recorded, &runs[0]))
+			return 0;
+	}
+	for (size_t t = 0; recorded == NULL && t < traces.size(); ++t)
+	{
+		runs.push_back(make_trace(traces[t], seed, allocations));
+		if (runs.back().ops.empty())
+		{
+			printf("ERROR: Unknown trace %s (expected ackerman, uniform, powerlaw or prodcons)!\n", traces[t].c_str());
+			return 0;
+		}
+	}
+
+	vector<Result> results;
+	for (size_t t = 0; t < runs.size(); ++t)
+	{
+		for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); ++b)
+		{
+			if (only_backend == NULL || string(only_backend) == backends[b].name)
+				results.push_back(run(runs[t], backends[b], basic_block_size, memory_length));
+		}
+	}
+	if (results.empty())
+	{
+		printf("ERROR: Unknown allocator %s (expected buddy, buddy-slab, buddy-lazy or malloc)!\n", only_backend);
+		return 0;
+	}
+	print_results(results, format);
+}
@@ -0,0 +1,118 @@
+/*
+    File: AllocTest.cpp
+
+    Edge cases of the BuddyAllocator that the Ackerman run never reaches. Every
+    check prints a line; the exit status is the number of failed checks. The C
+    allocation functions are checked too, so 'make test' also runs it on top of
+    libbuddymalloc.so. Given a path, it also records a short trace with unusual
+    requests there, which 'make test' replays with allocbench -i:
+
+        alloctest [replay trace]
+        LD_PRELOAD=./libbuddymalloc.so ./alloctest
+*/
+
+#include "BuddyAllocator.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool passed, const char* what, int line)
+{
+	printf("%s  line %d: %s\n", passed ? "ok  " : "FAIL", line, what);
+	if (!passed)
+		++failures;
+}
+
+static void test_oversized(int options)
+{ // Requests whose rounded block size would wrap past SIZE_MAX must fail instead of returning a small block
+	printf("oversized requests (options %d)\n", options);
+	BuddyAllocator ba(128, 1 << 20, options | BA_QUIET);
+
+	CHECK(ba.alloc(SIZE_MAX) == nullptr);
+	CHECK(ba.alloc(SIZE_MAX - 16) == nullptr);
+	CHECK(ba.alloc(MAX_BLOCK_SIZE + 1) == nullptr);
+	CHECK(ba.alloc_aligned(SIZE_MAX, 64) == nullptr);
+	CHECK(ba.alloc_aligned(SIZE_MAX - 100, 4096) == nullptr);
+
+	char* out[4];
+	CHECK(ba.alloc_batch(SIZE_MAX, 4, out) == 0);
+
+	char* mem = ba.alloc(1000);
+	CHECK(mem != nullptr);
+	CHECK(ba.realloc(mem, SIZE_MAX) == nullptr);
+	CHECK(ba.usable_size(mem) < 4096); // the block was left as it was
+	ba.free(mem);
+
+	BuddyStats st = ba.stats();
+	CHECK(st.failed_allocations >= 6);
+	CHECK(st.bytes_in_use == st.bytes_cached); // nothing leaked (magazines keep blocks in concurrent mode)
+}
+
+static void test_malloc_limits()
+{ // Impossible sizes fail with ENOMEM (volatile, or the compiler may decide the result itself)
+	printf("malloc limits\n");
+	volatile size_t huge = SIZE_MAX;
+
+	errno = 0;
+	CHECK(malloc(huge) == nullptr && errno == ENOMEM);
+	errno = 0;
+	CHECK(calloc(huge / 2, 4) == nullptr && errno == ENOMEM);
+	errno = 0;
+	CHECK(aligned_alloc(64, huge - 63) == nullptr && errno == ENOMEM);
+
+	void* mem = nullptr;
+	CHECK(posix_memalign(&mem, 4096, huge) == ENOMEM && mem == nullptr);
+
+	char* block = (char*) malloc(100);
+	CHECK(block != nullptr);
+	block[99] = 1;
+	errno = 0;
+	char* moved = (char*) realloc(block, huge);
+	CHECK(moved == nullptr && errno == ENOMEM);
+	if (moved == nullptr)
+	{ // the old block is still valid after a failed realloc
+		CHECK(block[99] == 1);
+		free(block);
+	}
+}
+
+static void record_replay_trace(const char* path)
+{ // Records requests allocbench must replay without touching memory they do not own
+	printf("replay trace %s\n", path);
+	BuddyAllocator ba(128, 1 << 20, BA_QUIET);
+	CHECK(ba.start_trace(path));
+
+	char* empty = ba.alloc(0);
+	char* small = ba.alloc(100);
+	ba.free(empty);
+	ba.free(small);
+	empty = ba.alloc(0);
+	ba.free(empty);
+	CHECK(ba.alloc(SIZE_MAX) == nullptr); // recorded with its size all the same
+
+	ba.stop_trace();
+
+	// Records no recorder writes, which the replay skips: an unknown operation and a free of an unknown id
+	TraceRecord corrupt[2] = {{0, 64, 4, 0, 7}, {0, 0, 1000, 0, TRACE_FREE}};
+	FILE* f = fopen(path, "ab");
+	CHECK(f != NULL && fwrite(corrupt, sizeof(corrupt), 1, f) == 1);
+	if (f != NULL)
+		fclose(f);
+}
+
+int main(int argc, char** argv)
+{
+	test_oversized(BA_DEFAULT);
+	test_oversized(BA_NO_HEADER);
+	test_oversized(BA_CONCURRENT | BA_SLAB);
+	test_malloc_limits();
+	if (argc > 1)
+		record_replay_trace(argv[1]);
+
+	printf("%d failed\n", failures);
+	return failures;
+}
@@ -0,0 +1,260 @@
+/*
+    File: Benchmark.cpp
+
+    Measures how the cost of BuddyAllocator::free() changes as the free lists
+    grow. For each fragmentation level N, an arena of 2N basic blocks is filled,
+    every other block is freed (leaving N unmergeable blocks on the smallest
+    free list), and then a sample of the remaining blocks is freed. Each of
+    those frees has to unlink its buddy from the crowded list before merging.
+
+    It also measures alloc/free throughput of a BA_CONCURRENT allocator as the
+    number of threads sharing it grows, and compares eager merging against
+    BA_LAZY on the Ackerman workload (splits, merges and throughput), and
+    alloc_batch/free_batch against one alloc/free per object.
+*/
+
+#include "BuddyAllocator.h"
+#include <algorithm>
+#include <random>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <pthread.h>
+using namespace std;
+
+static long long now_ns()
+{ // Returns a monotonic timestamp in nanoseconds
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+double free_latency(int basic_block_size, int num_free_blocks, int samples)
+{ // Returns the average latency (ns) of a merging free() with num_free_blocks blocks on the smallest free list
+	BuddyAllocator ba(basic_block_size, 2 * num_free_blocks * basic_block_size);
+	int request = basic_block_size - sizeof(BlockHeader);
+
+	vector<char*> blocks;
+	for (int i = 0; i < 2 * num_free_blocks; ++i)
+	{
+		char* mem = ba.alloc(request);
+		if (mem == nullptr)
+			break;
+		blocks.push_back(mem);
+	}
+	sort(blocks.begin(), blocks.end());
+
+	// Free one block out of every buddy pair so none of them can merge yet
+	for (size_t i = 1; i < blocks.size(); i += 2)
+		ba.free(blocks[i]);
+
+	// Free a random sample of the other halves, each one merges with its buddy
+	vector<char*> victims;
+	for (size_t i = 0; i < blocks.size(); i += 2)
+		victims.push_back(blocks[i]);
+	shuffle(victims.begin(), victims.end(), default_random_engine(313));
+	if ((int) victims.size() > samples)
+		victims.resize(samples);
+
+	long long start = now_ns();
+	for (size_t i = 0; i < victims.size(); ++i)
+		ba.free(victims[i]);
+	long long end = now_ns();
+
+	return victims.empty() ? 0 : (double) (end - start) / victims.size();
+}
+
+struct scaling_thread_args
+{
+	BuddyAllocator* ba;
+	int ops;
+	unsigned int seed;
+};
+
+void* scaling_thread_function(void* arg)
+{ // keeps a small window of live blocks of random small sizes, replacing one per iteration
+	struct scaling_thread_args* arguments = (struct scaling_thread_args*) arg;
+	char* window[64] = {};
+
+	for (int i = 0; i < arguments->ops; ++i)
+	{
+		int slot = rand_r(&arguments->seed) % 64;
+		if (window[slot] != nullptr)
+			arguments->ba->free(window[slot]);
+		window[slot] = arguments->ba->alloc(16 + rand_r(&arguments->seed) % 1000);
+	}
+
+	for (int i = 0; i < 64; ++i)
+	{
+		if (window[i] != nullptr)
+			arguments->ba->free(window[i]);
+	}
+	pthread_exit(NULL);
+}
+
+double thread_scaling(int basic_block_size, int threads, int ops_per_thread)
+{ // Returns the alloc/free pairs per second achieved by 'threads' threads sharing one allocator
+	BuddyAllocator ba(basic_block_size, 64 * 1024 * 1024, BA_CONCURRENT);
+	pthread_t tids[threads];
+	struct scaling_thread_args args[threads];
+
+	long long start = now_ns();
+	for (int i = 0; i < threads; ++i)
+	{
+		args[i].ba = &ba;
+		args[i].ops = ops_per_thread;
+		args[i].seed = i + 1;
+		pthread_create(&tids[i], NULL, scaling_thread_function, (void*) &args[i]);
+	}
+	for (int i = 0; i < threads; ++i)
+	{
+		pthread_join(tids[i], NULL);
+	}
+	long long end = now_ns();
+
+	return (double) threads * ops_per_thread / ((end - start) / 1e9);
+}
+
+static int ackerman_workload(BuddyAllocator* ba, unsigned int* seed, int a, int b, unsigned long long* allocations)
+{ // Ackerman::Recurse's allocation pattern (same sizes and nesting) without filling and checking the memory
+	int to_alloc = ((2 << (rand_r(seed) % 19)) * (rand_r(seed) % 100)) / 100;
+	if (to_alloc < 4)
+		to_alloc = 4;
+
+	int result = 0;
+	char* mem = ba->alloc(to_alloc);
+	++*allocations;
+	if (mem != nullptr)
+	{
+		if (a == 0)
+			result = b + 1;
+		else if (b == 0)
+			result = ackerman_workload(ba, seed, a - 1, 1, allocations);
+		else
+			result = ackerman_workload(ba, seed, a - 1, ackerman_workload(ba, seed, a, b - 1, allocations), allocations);
+		ba->free(mem);
+	}
+	return result;
+}
+
+BuddyStats coalescing(int basic_block_size, int options, double* ops_per_sec)
+{ // Runs Ackerman(3, 6)'s allocation pattern and returns the allocator's counters afterwards
+	BuddyAllocator ba(basic_block_size, 128 * 1024 * 1024, options | BA_QUIET);
+	unsigned int seed = 1;
+	unsigned long long allocations = 0;
+
+	long long start = now_ns();
+	ackerman_workload(&ba, &seed, 3, 6, &allocations);
+	long long end = now_ns();
+
+	*ops_per_sec = (double) allocations / ((end - start) / 1e9);
+	return ba.stats();
+}
+
+BuddyStats batching(int basic_block_size, bool batched, int rounds, double* ns_per_object)
+{ // Allocates and frees 1024 message-sized buffers per round, one at a time or as one batch
+	const uint count = 1024;
+	BuddyAllocator ba(basic_block_size, 64 * 1024 * 1024, BA_QUIET);
+	char* buffers[count];
+
+	long long start = now_ns();
+	for (int r = 0; r < rounds; ++r)
+	{
+		if (batched)
+		{
+			ba.alloc_batch(256, count, buffers);
+			ba.free_batch(buffers, count);
+		}
+		else
+		{
+			for (uint i = 0; i < count; ++i)
+				buffers[i] = ba.alloc(256);
+			for (uint i = 0; i < count; ++i)
+				ba.free(buffers[i]);
+		}
+	}
+	long long end = now_ns();
+
+	*ns_per_object = (double) (end - start) / ((double) rounds * count);
+	return ba.stats();
+}
+
+int main(int argc, char** argv)
+{
+	int basic_block_size = 128, samples = 1000;
+
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "b:n:")) != -1)
+	{ // While options were received from getopt
+		int n = atoi(optarg);
+		switch (opt)
+		{
+			case 'b': // If block size is specified
+				if (n <= (int) sizeof(BlockHeader))
+				{
+					printf("ERROR: Block size must be larger than a BlockHeader (%u bytes)!\n", (unsigned) sizeof(BlockHeader));
+					return 0;
+				}
+				basic_block_size = n;
+				break;
+			case 'n': // If number of timed frees per level is specified
+				if (n < 1)
+				{
+					printf("ERROR: Number of samples must be strictly positive!\n");
+					return 0;
+				}
+				samples = n;
+				break;
+			case '?': // If unknown, end the program (getopt produces its own error message)
+				return 0;
+		}
+	}
+
+	int levels[] = {1 << 10, 1 << 12, 1 << 14, 1 << 16, 1 << 18};
+	double results[sizeof(levels) / sizeof(levels[0])];
+
+	for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i)
+	{
+		results[i] = free_latency(basic_block_size, levels[i], samples);
+	}
+
+	printf("\n%16s %16s\n", "free blocks", "ns per free()");
+	for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i)
+	{
+		printf("%16d %16.1f\n", levels[i], results[i]);
+	}
+
+	int thread_counts[] = {1, 2, 4, 8};
+	double throughput[sizeof(thread_counts) / sizeof(thread_counts[0])];
+
+	for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); ++i)
+	{
+		throughput[i] = thread_scaling(basic_block_size, thread_counts[i], 200000);
+	}
+
+	printf("\n%16s %16s\n", "threads", "ops per second");
+	for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); ++i)
+	{
+		printf("%16d %16.0f\n", thread_counts[i], throughput[i]);
+	}
+
+	const char* modes[] = {"eager", "lazy"};
+	int mode_options[] = {BA_DEFAULT, BA_LAZY};
+	printf("\n%16s %16s %16s %16s\n", "coalescing", "splits", "merges", "ops per second");
+	for (int i = 0; i < 2; ++i)
+	{
+		double ops_per_sec;
+		BuddyStats st = coalescing(basic_block_size, mode_options[i], &ops_per_sec);
+		printf("%16s %16llu %16llu %16.0f\n", modes[i], st.splits, st.merges, ops_per_sec);
+	}
+
+	printf("\n%16s %16s %16s %16s\n", "1024 x 256 B", "splits", "merges", "ns per object");
+	for (int i = 0; i < 2; ++i)
+	{
+		double ns_per_object;
+		BuddyStats st = batching(basic_block_size, i == 1, 100, &ns_per_object);
+		printf("%16s %16llu %16llu %16.1f\n", (i == 1) ? "batch" : "single", st.splits, st.merges, ns_per_object);
+	}
+}
@@ -3,152 +3,1010 @@
 */
 #include "BuddyAllocator.h"
 #include "Helper.cpp"
+#include <algorithm>
 #include <iostream>
-#include <math.h>
+#include <new>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 using namespace std;
 
-BuddyAllocator::BuddyAllocator(int _basic_block_size, int _total_memory_length)
+// object sizes of the slab size classes, multiples of SLAB_ALIGN spaced roughly 25% apart
+static const uint slab_class_sizes[SLAB_CLASSES] = {16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512};
+
+BuddyAllocator::BuddyAllocator(int _basic_block_size, size_t _total_memory_length, int _options)
 { // Creates the framework for a buddy system memory allocator and reserves a portion of memory for its use
+	options = _options;
+	header_size = (options & BA_NO_HEADER) ? 0 : sizeof(BlockHeader);
+	page_size = sysconf(_SC_PAGESIZE);
 	basic_block_size = next_power_of_2(_basic_block_size);
 	total_size = next_power_of_2(_total_memory_length);
 
-	if (total_size < sizeof(BlockHeader) + basic_block_size)
+	if ((options & BA_NO_HEADER) && basic_block_size < sizeof(BlockHeader))
+	{ // Free blocks still hold their free list links in-band
+		if (!(options & BA_QUIET))
+			printf("ERROR: Basic block size cannot hold a free list node, changing basic block size!\n");
+		basic_block_size = next_power_of_2(sizeof(BlockHeader));
+	}
+
+	if (total_size < header_size + basic_block_size)
 	{
-		printf("ERROR: Total size is not large enough to accommodate the basic block size, changing total size!\n");
-		total_size = next_power_of_2(sizeof(BlockHeader) + basic_block_size);
+		if (!(options & BA_QUIET))
+			printf("ERROR: Total size is not large enough to accommodate the basic block size, changing total size!\n");
+		total_size = next_power_of_2(header_size + basic_block_size);
 	}
 
-	printf("Base block size now %u\n", basic_block_size); //DEBUG
-	printf("Total size now %u\n", total_size); //DEBUG
+	if (!(options & BA_QUIET))
+	{
+		printf("Base block size now %u\n", basic_block_size); //DEBUG
+		printf("Total size now %zu\n", total_size); //DEBUG
+	}
 
-	// create new array of LinkedLists of size max_depth + 1 (max_depth is max indexable depth)
-	max_depth = log2(total_size / basic_block_size);
-	free_list = new LinkedList[max_depth + 1];
+	if (options & BA_CONCURRENT)
+	{ // Shared arenas need a lock around the buddy tree and a magazine per thread
+		pthread_mutex_init(&mtx, NULL);
+		pthread_key_create(&cache_key, release_thread_cache);
+	}
 
-	// Allocate a new block of size total_size
-	base_addr = new char[total_size];
+	slab_page_size = (basic_block_size > SLAB_PAGE_SIZE) ? basic_block_size : SLAB_PAGE_SIZE;
+	if ((options & BA_SLAB) && total_size < slab_page_size)
+	{
+		if (!(options & BA_QUIET))
+			printf("ERROR: Total size is too small for slab pages, disabling the slab front end!\n");
+		options &= ~BA_SLAB;
+	}
 
-	// Add BlockHeader to beginning of block and insert into free_list
-	BlockHeader* base_head = (BlockHeader*) base_addr;
-	base_head->block_size = total_size;
-	base_head->free = true;
-	free_list[max_depth].insert(base_head);
+	if (options & BA_SLAB)
+	{ // Build the size -> class lookup table
+		for (uint c = 0, i = 0; i <= SLAB_MAX_SIZE / SLAB_ALIGN; ++i)
+		{
+			while (slab_class_sizes[c] < i * SLAB_ALIGN)
+				++c;
+			slab_class_index[i] = c;
+		}
+		for (uint c = 0; c < SLAB_CLASSES; ++c)
+		{
+			slab_classes[c].object_size = slab_class_sizes[c];
+			if (options & BA_CONCURRENT)
+				pthread_mutex_init(&slab_classes[c].lock, NULL);
+		}
+
+		slab_object_offset = (header_size + sizeof(SlabHeader) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+	}
+
+	// Reserve the first arena of size total_size (pages are only committed once touched)
+	arenas = last_arena = create_arena(total_size);
+	if (arenas == nullptr)
+	{
+		if (!(options & BA_QUIET))
+			printf("ERROR: Could not map an arena of %zu bytes!\n", total_size);
+		exit(EXIT_FAILURE);
+	}
 }
 
 BuddyAllocator::~BuddyAllocator()
 {
-	// Delete dynamically allocated memory
-	delete[] base_addr;
-	delete[] free_list;
+	stop_trace();
+
+	if (options & BA_CONCURRENT)
+	{ // Caches of threads that are still running are dropped along with the arena
+		pthread_key_delete(cache_key);
+		while (caches != nullptr)
+		{
+			ThreadCache* next = caches->next;
+			munmap(caches, sizeof(ThreadCache));
+			caches = next;
+		}
+		pthread_mutex_destroy(&mtx);
+		if (options & BA_SLAB)
+		{
+			for (uint c = 0; c < SLAB_CLASSES; ++c)
+				pthread_mutex_destroy(&slab_classes[c].lock);
+		}
+	}
+
+	// Unmap every arena along with its metadata
+	while (arenas != nullptr)
+	{
+		Arena* next = arenas->next;
+		munmap(arenas->base_addr, arenas->total_size);
+		munmap(arenas, arenas->metadata_size);
+		arenas = next;
+	}
 }
 
-char* BuddyAllocator::alloc(int _length)
+char* BuddyAllocator::alloc(size_t _length)
 { // Returns a pointer to the beginning of a usable portion of memory of a specified size
-	uint free_block_size = 0;
-	
-	//printf("\nALLOC\n"); //DEBUG
+	char* mem = alloc_memory(_length);
+	if (recorder != nullptr)
+		recorder->record_alloc(mem, _length);
+	return mem;
+}
 
-	// Find actual length needed
-	//printf("%i bytes requested\n", _length); //DEBUG
-	_length = next_power_of_2(_length + sizeof(BlockHeader));
-	//printf("(%i actual)\n", _length); //DEBUG
+int BuddyAllocator::free(char* _a)
+{ // Frees a block allocated by alloc()
+	if (recorder != nullptr)
+		recorder->record_free(_a); // before the address can be handed out again
+	return free_memory(_a);
+}
 
-	// Check if input is valid
-	if (_length <= basic_block_size)
-	{
-		_length = basic_block_size;
+char* BuddyAllocator::alloc_memory(size_t _length)
+{ // Finds and takes a block for a request (see alloc)
+	//printf("\nALLOC\n"); //DEBUG
+	if ((options & BA_SLAB) && _length <= SLAB_MAX_SIZE)
+	{ // Small requests are packed into slabs instead of rounding them up to a whole block
+		char* mem = slab_alloc(_length);
+		if (mem != nullptr)
+			return mem;
 	}
-	else if(_length > total_size)
+
+	return alloc_buddy(_length);
+}
+
+char* BuddyAllocator::alloc_buddy(size_t _length)
+{ // Takes a buddy block for a request, bypassing the slab front end
+	size_t requested = _length;
+
+	// Check if input is valid (requests larger than an arena get an arena of their own)
+	if (_length > MAX_BLOCK_SIZE - header_size)
 	{
-		printf("ERROR: Cannot allocate block larger than %u bytes!\n", (unsigned) (total_size - sizeof(BlockHeader)));
-		printf("(%i bytes requested)\n", _length);
+		if (!(options & BA_QUIET))
+		{
+			printf("ERROR: Cannot allocate a block that large!\n");
+			printf("(%zu bytes requested)\n", requested);
+		}
+		tally(usage.failed_allocations);
 		return nullptr;
 	}
 
-	uint depth = log2(_length / basic_block_size);
+	// Find actual length needed
+	//printf("%zu bytes requested\n", _length); //DEBUG
+	_length = next_power_of_2(_length + header_size);
+	//printf("(%zu actual)\n", _length); //DEBUG
+	if (_length <= basic_block_size)
+		_length = basic_block_size;
 
-	// Find large enough block on the free list starting at the smallest
-	for(uint i = depth; i <= max_depth; ++i)
+	uint depth = get_depth(_length);
+	BlockHeader* block = nullptr;
+	UsageCounters* counters = &usage;
+
+	if (options & BA_CONCURRENT)
 	{
-		if (free_list[i].get_size() > 0)
+		ThreadCache* cache = get_thread_cache(); // nullptr if its magazines could not be mapped
+		if (cache != nullptr)
+			counters = &cache->usage;
+
+		if (cache != nullptr && depth < MAGAZINE_ORDERS)
+		{ // Small blocks come out of this thread's magazine, refilled in bulk on a miss
+			if (cache->count[depth] == 0)
+				refill_magazine(cache, depth);
+			uint count = cache->count[depth];
+			if (count > 0)
+			{
+				block = cache->blocks[depth][count - 1];
+				__atomic_store_n(&cache->count[depth], count - 1, __ATOMIC_RELAXED);
+			}
+		}
+		else
 		{
-			free_block_size = free_list[i].get_head()->block_size;
-			break;
+			pthread_mutex_lock(&mtx);
+			block = alloc_block(depth);
+			pthread_mutex_unlock(&mtx);
 		}
-	}
 
-	// If there was no large enough block on the free list
-	if (free_block_size == 0)
+		if (block == nullptr && cache != nullptr)
+		{ // Blocks parked in this thread's magazines may be hiding the memory we need
+			flush_thread_cache(cache, 0);
+			pthread_mutex_lock(&mtx);
+			block = alloc_block(depth);
+			pthread_mutex_unlock(&mtx);
+		}
+	}
+	else
 	{
-		printf("ERROR: Could not find large enough free block!\n");
-		printf("(%u bytes requested)\n", _length);
-		printf("Current free blocks:\n");
-		debug();
-		return nullptr;
+		block = alloc_block(depth);
 	}
-	
-	uint free_block_level = log2(free_block_size / basic_block_size);
 
-	BlockHeader* block = free_list[free_block_level].get_head();
-	
-	// Whittle down block until it is the same size as _length (which is a power of two)
-	while (block->block_size > _length)
+	// If there was no large enough block on the free list
+	if (block == nullptr)
 	{
-		block = split(block);
-		--free_block_level;
+		if (!(options & BA_QUIET))
+		{
+			printf("ERROR: Could not find large enough free block!\n");
+			printf("(%zu bytes requested)\n", _length);
+			printf("Current free blocks:\n");
+			if (options & BA_CONCURRENT)
+				pthread_mutex_lock(&mtx); // other threads may be splitting and merging the lists debug walks
+			debug();
+			if (options & BA_CONCURRENT)
+				pthread_mutex_unlock(&mtx);
+		}
+		tally(counters->failed_allocations);
+		return nullptr;
 	}
 
-	// Remove allocated block from the free list
-	free_list[free_block_level].remove(block);
-	block->free = false;
+	tally(counters->buddy_allocations);
+	tally(counters->buddy_requested_bytes, requested);
+	tally(counters->buddy_consumed_bytes, block->block_size);
 
 	//printf("Allocating block of size %u\n", block->block_size);
 	//printf("Current free blocks:\n");
 	//debug(); //DEBUG
 
 	// Return the beginning of the block/the end of the metadata
-	return (char*) block + sizeof(BlockHeader);
+	return (char*) block + header_size;
 }
 
-int BuddyAllocator::free(char* _a)
-{ // Frees a block allocated by alloc()
+int BuddyAllocator::free_memory(char* _a)
+{ // Hands a block back to its slab or the buddy tree (see free)
 	//printf("\nFREE\n"); //DEBUG
 
+	Arena* arena = arena_of(_a);
+	if (arena == nullptr)
+	{
+		if (!(options & BA_QUIET))
+			printf("ERROR: Attempt to free memory that was not allocated by this allocator!\n");
+		return 0;
+	}
+
+	if (options & BA_SLAB)
+	{ // Objects inside a slab page have no header of their own
+		size_t page = (_a - arena->base_addr) / slab_page_size;
+		if (arena->slab_map[page] != 0)
+		{
+			slab_free(_a, arena, page);
+			tally(thread_usage()->frees);
+			return 1;
+		}
+	}
+
 	// Recover the metadata stashed away by alloc
-	BlockHeader* addr = (BlockHeader*) (_a - sizeof(BlockHeader));
+	BlockHeader* addr = header_of(arena, _a);
+
+	if (options & BA_CONCURRENT)
+	{
+		uint depth = get_depth(addr->block_size);
+		ThreadCache* cache = (depth < MAGAZINE_ORDERS) ? get_thread_cache() : nullptr;
+
+		if (cache != nullptr)
+		{ // Park small blocks in this thread's magazine, spilling half of it when full
+			if (cache->count[depth] == MAGAZINE_SIZE)
+				flush_magazine(cache, depth, MAGAZINE_SIZE / 2);
+			uint count = cache->count[depth];
+			cache->blocks[depth][count] = addr;
+			__atomic_store_n(&cache->count[depth], count + 1, __ATOMIC_RELAXED);
+			tally(cache->usage.frees);
+		}
+		else
+		{
+			pthread_mutex_lock(&mtx);
+			free_block(addr);
+			tally(usage.frees);
+			pthread_mutex_unlock(&mtx);
+		}
+	}
+	else
+	{
+		free_block(addr);
+		tally(usage.frees);
+	}
+
+	//printf("Freed block!\n");
+	//printf("Current free blocks:\n");
+	//debug(); //DEBUG
+	return 1;
+}
+
+BlockHeader* BuddyAllocator::alloc_block(uint depth)
+{ // Takes a block of the given depth out of the buddy tree, or returns nullptr if none is large enough
+	// Find the first arena whose smallest non-empty free list at or above depth exists
+	Arena* arena = arenas;
+	unsigned long long candidates = 0;
+	for (; arena != nullptr; arena = arena->next)
+	{
+		candidates = arena->free_orders & (~0ULL << depth);
+		if (candidates != 0)
+			break;
+	}
+
+	if (arena == nullptr && (options & BA_LAZY))
+	{ // Free blocks may only be too small because their buddies were never merged
+		for (arena = arenas; arena != nullptr; arena = arena->next)
+		{
+			if (depth <= arena->max_depth && coalesce(arena, depth))
+				break;
+		}
+		if (arena != nullptr)
+			candidates = arena->free_orders & (~0ULL << depth);
+	}
+
+	if (arena == nullptr)
+	{ // Every arena is exhausted, chain on a new one that is large enough for this request
+		size_t size = (size_t) basic_block_size << depth;
+		arena = create_arena((size > total_size) ? size : total_size);
+		if (arena == nullptr)
+			return nullptr;
+
+		__atomic_store_n(&last_arena->next, arena, __ATOMIC_RELEASE); // free() walks the chain without the lock
+		last_arena = arena;
+		candidates = arena->free_orders & (~0ULL << depth);
+	}
+
+	uint free_block_level = __builtin_ctzll(candidates);
+
+	BlockHeader* block = arena->free_list[free_block_level].get_head();
+	
+	// Whittle down block until it is the right size
+	while (free_block_level > depth)
+	{
+		block = split(arena, block);
+		--free_block_level;
+	}
+
+	// Remove allocated block from the free list
+	remove_free(arena, block, free_block_level);
+	block->free = false;
+	set_block_info(arena, block, depth, false);
+	return block;
+}
+
+void BuddyAllocator::free_block(BlockHeader* addr)
+{ // Returns a block to the buddy tree, merging it with its buddy as far up as possible
+	Arena* arena = arena_of((char*) addr);
 
 	// Add the header back to the free list
-	uint depth = log2(addr->block_size / basic_block_size);
-	free_list[depth].insert(addr);
+	uint depth = get_depth(addr->block_size);
+	insert_free(arena, addr, depth);
 	addr->free = true;
 
+	if (options & BA_LAZY)
+	{ // Merging waits until an allocation needs a larger block (see coalesce)
+		if (addr->block_size >= RELEASE_THRESHOLD)
+			release_pages(addr);
+		return;
+	}
+
 	//printf("About to free block of size %u\n", addr->block_size);
 	//printf("Current free blocks:\n");
 	//debug(); //DEBUG
 
+	// Large free blocks do not need to stay resident
+	if (addr->block_size >= RELEASE_THRESHOLD)
+		release_pages(addr);
+
 	// If there is more than one block in the free list, check if merge is needed
-	while(free_list[depth].get_size() > 1 && depth < max_depth)
+	while(arena->free_list[depth].get_size() > 1 && depth < arena->max_depth)
 	{
 		BlockHeader* buddy = getbuddy(addr);
 
-		if(buddy->free && arebuddies(addr, buddy))
+		if(buddy_is_free(arena, buddy, depth) && arebuddies(addr, buddy))
 		{
-			addr = merge(addr, buddy);
+			addr = merge(arena, addr, buddy);
 			++depth;
+
+			// Only the merge that crosses the threshold has resident pages to give back, the free
+			// blocks above it released theirs when they were freed (as in coalesce)
+			if (addr->block_size >= RELEASE_THRESHOLD && addr->block_size / 2 < RELEASE_THRESHOLD)
+				release_pages(addr);
 		}
 		else
 			break;
 	}
+}
+
+bool BuddyAllocator::coalesce(Arena* arena, uint depth)
+{ /* Merges free buddies order by order from the smallest up to depth, so merged blocks can merge again
+     on the next order. Blocks that reach RELEASE_THRESHOLD by merging give their pages back, like an
+     eager free of that size would have.
+  */
+	for (uint d = 0; d < depth; ++d)
+	{
+		BlockHeader* block = arena->free_list[d].get_head();
+		while (block != nullptr)
+		{
+			BlockHeader* next = block->next;
+			BlockHeader* buddy = getbuddy(block);
+			if (buddy_is_free(arena, buddy, d))
+			{
+				if (buddy == next)
+					next = next->next;
+				BlockHeader* merged = merge(arena, block, buddy);
+				if (merged->block_size >= RELEASE_THRESHOLD && merged->block_size / 2 < RELEASE_THRESHOLD)
+					release_pages(merged);
+			}
+			block = next;
+		}
+	}
+	return (arena->free_orders & (~0ULL << depth)) != 0;
+}
 
-	//printf("Freed block!\n");
-	//printf("Current free blocks:\n");
-	//debug(); //DEBUG
-	return 1;
+ThreadCache* BuddyAllocator::get_thread_cache()
+{ // Returns the calling thread's magazines, creating and registering them on first use
+	ThreadCache* cache = (ThreadCache*) pthread_getspecific(cache_key);
+	if (cache == nullptr)
+	{
+		// ThreadCaches are mapped directly so the allocator never calls into malloc itself
+		void* mem = mmap(NULL, sizeof(ThreadCache), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED)
+			return nullptr;
+		cache = new (mem) ThreadCache();
+		cache->owner = this;
+
+		pthread_mutex_lock(&mtx);
+		cache->next = caches;
+		if (caches != nullptr)
+			caches->prev = cache;
+		caches = cache;
+		pthread_mutex_unlock(&mtx);
+
+		pthread_setspecific(cache_key, cache);
+	}
+	return cache;
+}
+
+UsageCounters* BuddyAllocator::thread_usage()
+{ // The counters of the calling thread's cache in concurrent mode, else (or without a cache) the shared ones
+	if (options & BA_CONCURRENT)
+	{
+		ThreadCache* cache = get_thread_cache();
+		if (cache != nullptr)
+			return &cache->usage;
+	}
+	return &usage;
+}
+
+void BuddyAllocator::refill_magazine(ThreadCache* cache, uint depth)
+{ // Moves up to half a magazine of blocks from the buddy tree into the cache under one lock
+	pthread_mutex_lock(&mtx);
+	while (cache->count[depth] < MAGAZINE_SIZE / 2)
+	{
+		BlockHeader* block = alloc_block(depth);
+		if (block == nullptr)
+			break;
+		cache->blocks[depth][cache->count[depth]++] = block;
+	}
+	pthread_mutex_unlock(&mtx);
+}
+
+void BuddyAllocator::flush_magazine(ThreadCache* cache, uint depth, uint keep)
+{ // Returns all but 'keep' cached blocks of the given depth to the buddy tree under one lock
+	pthread_mutex_lock(&mtx);
+	while (cache->count[depth] > keep)
+	{
+		free_block(cache->blocks[depth][--cache->count[depth]]);
+	}
+	pthread_mutex_unlock(&mtx);
+}
+
+void BuddyAllocator::flush_thread_cache(ThreadCache* cache, uint keep)
+{ // Flushes every magazine of a thread cache down to 'keep' blocks
+	for (uint i = 0; i < MAGAZINE_ORDERS; ++i)
+	{
+		if (cache->count[i] > keep)
+			flush_magazine(cache, i, keep);
+	}
+}
+
+void BuddyAllocator::release_thread_cache(void* _cache)
+{ // pthread key destructor: hands an exiting thread's cached blocks back to its allocator
+	ThreadCache* cache = (ThreadCache*) _cache;
+	BuddyAllocator* ba = cache->owner;
+
+	ba->flush_thread_cache(cache, 0);
+
+	pthread_mutex_lock(&ba->mtx);
+	ba->tally(ba->usage.buddy_allocations, cache->usage.buddy_allocations);
+	ba->tally(ba->usage.buddy_requested_bytes, cache->usage.buddy_requested_bytes);
+	ba->tally(ba->usage.buddy_consumed_bytes, cache->usage.buddy_consumed_bytes);
+	ba->tally(ba->usage.frees, cache->usage.frees);
+	ba->tally(ba->usage.failed_allocations, cache->usage.failed_allocations);
+
+	if (cache->prev != nullptr)
+		cache->prev->next = cache->next;
+	else
+		ba->caches = cache->next;
+	if (cache->next != nullptr)
+		cache->next->prev = cache->prev;
+	pthread_mutex_unlock(&ba->mtx);
+
+	munmap(cache, sizeof(ThreadCache));
+}
+
+void BuddyAllocator::tally(unsigned long long& counter, unsigned long long n)
+{ // Relaxed is enough: the counters order nothing, stats() only must not see torn or lost updates
+	if (options & BA_CONCURRENT)
+		__atomic_fetch_add(&counter, n, __ATOMIC_RELAXED);
+	else
+		counter += n;
+}
+
+char* BuddyAllocator::alloc_aligned(size_t _length, size_t _alignment)
+{ // Returns memory aligned to _alignment by using a block at least that large (blocks are aligned to their size)
+	if (_alignment == 0 || (_alignment & (_alignment - 1)) != 0)
+	{
+		if (!(options & BA_QUIET))
+			printf("ERROR: Alignment must be a power of two!\n");
+		return nullptr;
+	}
+
+	char* mem;
+	if (_alignment <= SLAB_ALIGN && header_size % _alignment == 0)
+		mem = alloc_memory(_length); // every pointer is at least this aligned already
+	else if (header_size == 0)
+		mem = alloc_buddy((_length > _alignment) ? _length : _alignment);
+	else
+	{ /* The header sits in front of the data, so the data starts _alignment bytes into the block and a
+	     shadow header (block_size 0) right before it points back to the real one for free()
+	  */
+		if (_alignment < header_size)
+			_alignment = header_size;
+		if (_length > MAX_BLOCK_SIZE || _alignment > MAX_BLOCK_SIZE - _length)
+			mem = alloc_buddy(SIZE_MAX); // the sum would wrap; fails like any other oversized request
+		else
+			mem = alloc_buddy(_length + _alignment);
+		if (mem != nullptr && _alignment > header_size)
+		{
+			BlockHeader* block = (BlockHeader*) (mem - header_size);
+			mem = (char*) block + _alignment;
+			BlockHeader* shadow = (BlockHeader*) (mem - header_size);
+			shadow->block_size = 0;
+			shadow->next = block;
+		}
+	}
+
+	if (recorder != nullptr)
+		recorder->record_alloc(mem, _length);
+	return mem;
+}
+
+uint BuddyAllocator::alloc_batch(size_t _length, uint _count, char** _out)
+{ /* Allocates _count objects of _length bytes under one lock. Slab-sized objects come from their slab class;
+     buddy blocks are carved out of as few large blocks as possible, so only the halves left over at the
+     edge of a batch touch the free lists. Returns how many objects were allocated.
+  */
+	uint done = 0;
+
+	if ((options & BA_SLAB) && _length <= SLAB_MAX_SIZE)
+	{ // (slab classes have locks of their own, taken before mtx)
+		for (; done < _count; ++done)
+		{
+			_out[done] = slab_alloc(_length);
+			if (_out[done] == nullptr)
+				break;
+		}
+	}
+
+	if (options & BA_CONCURRENT)
+		pthread_mutex_lock(&mtx);
+
+	// (oversized objects get a depth beyond any arena, so nothing is carved and alloc_buddy rejects them below)
+	size_t block_size = (_length <= MAX_BLOCK_SIZE - header_size) ? next_power_of_2(_length + header_size) : MAX_BLOCK_SIZE;
+	if (block_size < basic_block_size)
+		block_size = basic_block_size;
+	uint depth = get_depth(block_size);
+	uint max_depth = get_depth(total_size);	// never carve from more than a regular arena
+	uint carved = 0;
+
+	while (done + carved < _count && depth <= max_depth && block_size >= _length)
+	{
+		// Take the order that holds the rest of the batch, or else the largest free order that holds part of it
+		uint remaining = _count - done - carved;
+		uint order = depth + log2_pow2(next_power_of_2(remaining));
+		if (order > max_depth)
+			order = max_depth;
+
+		unsigned long long available = 0;
+		for (Arena* arena = arenas; arena != nullptr; arena = arena->next)
+			available |= arena->free_orders;
+		if ((available & (~0ULL << order)) == 0 && (available & (~0ULL << depth)) != 0)
+			order = 63 - __builtin_clzll(available & ((1ULL << order) - 1));
+
+		BlockHeader* block = alloc_block(order);
+		if (block == nullptr)
+			break;
+		carved += carve(arena_of((char*) block), block, order, depth, remaining, _out + done + carved);
+	}
+
+	if (options & BA_CONCURRENT)
+		pthread_mutex_unlock(&mtx);
+
+	if (carved > 0)
+	{ // (a thread's cache is created under mtx, so its counters are only looked up after unlocking)
+		UsageCounters* counters = thread_usage();
+		tally(counters->buddy_allocations, carved);
+		tally(counters->buddy_requested_bytes, (unsigned long long) carved * _length);
+		tally(counters->buddy_consumed_bytes, (unsigned long long) carved * block_size);
+		done += carved;
+	}
+
+	// Whatever could not be carved (e.g. objects larger than an arena) is allocated one at a time
+	for (; done < _count; ++done)
+	{
+		_out[done] = alloc_buddy(_length);
+		if (_out[done] == nullptr)
+			break;
+	}
+
+	if (recorder != nullptr)
+	{
+		for (uint i = 0; i < done; ++i)
+			recorder->record_alloc(_out[i], _length);
+	}
+	return done;
+}
+
+uint BuddyAllocator::carve(Arena* arena, BlockHeader* block, uint order, uint depth, uint count, char** _out)
+{ /* Hands out the first 'count' blocks of the given depth inside an allocated block of the given order. When the
+     block holds more than that, it is split at the boundary and the unneeded right halves go to the free lists.
+     Returns how many blocks were handed out.
+  */
+	uint pieces = 1U << (order - depth);
+	size_t piece_size = (size_t) basic_block_size << depth;
+
+	if (count >= pieces)
+	{ // The whole block is used
+		for (uint i = 0; i < pieces; ++i)
+		{
+			BlockHeader* piece = (BlockHeader*) ((char*) block + i * piece_size);
+			piece->block_size = piece_size;
+			piece->free = false;
+			set_block_info(arena, piece, depth, false);
+			_out[i] = (char*) piece + header_size;
+		}
+		return pieces;
+	}
+
+	size_t half_size = (size_t) basic_block_size << (order - 1);
+	BlockHeader* right = (BlockHeader*) ((char*) block + half_size);
+	uint done = carve(arena, block, order - 1, depth, count, _out);
+	if (count > pieces / 2)
+		done += carve(arena, right, order - 1, depth, count - pieces / 2, _out + done);
+	else
+	{ // Nothing of the right half is needed
+		right->block_size = half_size;
+		right->free = true;
+		insert_free(arena, right, order - 1);
+		++splits;
+	}
+	return done;
+}
+
+uint BuddyAllocator::free_batch(char** _ptrs, uint _count)
+{ /* Frees _count objects under one lock. Sorted by address, runs of neighbouring blocks of one size go back
+     to the buddy tree as the fewest aligned power-of-two blocks, so they merge once per chunk instead of once
+     per object. Reorders _ptrs; returns how many objects were freed.
+  */
+	if (recorder != nullptr)
+	{
+		for (uint i = 0; i < _count; ++i)
+			recorder->record_free(_ptrs[i]);
+	}
+	sort(_ptrs, _ptrs + _count);
+
+	uint freed = 0, run_length = 0;
+	Arena* run_arena = nullptr;
+	BlockHeader* run = nullptr;
+
+	// Slab objects go back first, under their class locks, which are taken before mtx
+	uint blocks = 0;
+	for (uint i = 0; i < _count; ++i)
+	{
+		Arena* arena = arena_of(_ptrs[i]);
+		if (arena == nullptr)
+		{
+			if (_ptrs[i] != nullptr && !(options & BA_QUIET))
+				printf("ERROR: Attempt to free memory that was not allocated by this allocator!\n");
+			continue;
+		}
+		++freed;
+
+		if (options & BA_SLAB)
+		{
+			size_t page = (_ptrs[i] - arena->base_addr) / slab_page_size;
+			if (arena->slab_map[page] != 0)
+			{
+				slab_free(_ptrs[i], arena, page);
+				continue;
+			}
+		}
+		_ptrs[blocks++] = _ptrs[i]; // buddy blocks stay in address order
+	}
+
+	if (options & BA_CONCURRENT)
+		pthread_mutex_lock(&mtx);
+	for (uint i = 0; i < blocks; ++i)
+	{
+		Arena* arena = arena_of(_ptrs[i]);
+		BlockHeader* block = header_of(arena, _ptrs[i]);
+		if (run_length > 0 && arena == run_arena && block->block_size == run->block_size &&
+			(char*) block == (char*) run + run_length * run->block_size)
+		{ // Extends the current run
+			++run_length;
+			continue;
+		}
+
+		if (run_length > 0)
+			free_run(run_arena, run, run_length);
+		run_arena = arena;
+		run = block;
+		run_length = 1;
+	}
+	if (run_length > 0)
+		free_run(run_arena, run, run_length);
+	tally(usage.frees, freed);
+	if (options & BA_CONCURRENT)
+		pthread_mutex_unlock(&mtx);
+
+	return freed;
+}
+
+void BuddyAllocator::free_run(Arena* arena, BlockHeader* start, uint count)
+{ // Frees 'count' neighbouring blocks of start's size as the largest aligned chunks they form (caller holds mtx)
+	size_t block_size = start->block_size;
+	char* chunk = (char*) start;
+	while (count > 0)
+	{
+		uint k = 0;
+		while ((1U << (k + 1)) <= count && (block_size << (k + 1)) <= arena->total_size &&
+			((uintptr_t) chunk & ((block_size << (k + 1)) - 1)) == 0)
+			++k;
+
+		((BlockHeader*) chunk)->block_size = block_size << k;
+		free_block((BlockHeader*) chunk);
+		chunk += block_size << k;
+		count -= 1U << k;
+	}
+}
+
+char* BuddyAllocator::realloc(char* _a, size_t _length)
+{ // Resizes an allocation, growing a buddy block in place when the blocks to its right are free
+	if (_a == nullptr)
+		return alloc(_length);
+
+	Arena* arena = arena_of(_a);
+	if (arena == nullptr)
+	{
+		if (!(options & BA_QUIET))
+			printf("ERROR: Attempt to realloc memory that was not allocated by this allocator!\n");
+		return nullptr;
+	}
+
+	size_t usable = usable_size(_a);
+	if (_length <= usable)
+	{
+		if (recorder != nullptr)
+		{
+			recorder->record_free(_a);
+			recorder->record_alloc(_a, _length);
+		}
+		return _a;
+	}
+
+	bool in_slab = (options & BA_SLAB) && arena->slab_map[(_a - arena->base_addr) / slab_page_size] != 0;
+	if (!in_slab)
+	{ // Only buddy blocks can absorb their buddies
+		if (options & BA_CONCURRENT)
+			pthread_mutex_lock(&mtx);
+		bool grown = grow_in_place(arena, _a, _length);
+		if (options & BA_CONCURRENT)
+			pthread_mutex_unlock(&mtx);
+		if (grown)
+		{
+			if (recorder != nullptr)
+			{
+				recorder->record_free(_a);
+				recorder->record_alloc(_a, _length);
+			}
+			return _a;
+		}
+	}
+
+	// Otherwise move the data to a new block
+	char* mem = alloc(_length);
+	if (mem == nullptr)
+		return nullptr;
+	memcpy(mem, _a, usable);
+	free(_a);
+	return mem;
+}
+
+bool BuddyAllocator::grow_in_place(Arena* arena, char* _a, size_t _length)
+{ /* Grows the buddy block behind _a to hold _length bytes by absorbing its right-hand buddies.
+     Succeeds only if the block is the left half at every level up to the target size and each
+     of those buddies is free; otherwise nothing is changed.
+  */
+	BlockHeader* block = (BlockHeader*) (_a - header_size);
+	if (arena->block_info == nullptr && header_of(arena, _a) != block)
+		return false; // an aligned pointer, its data does not start at the block's usual offset
+	size_t size = block_size_of(arena, _a);
+	if (_length > MAX_BLOCK_SIZE - header_size)
+		return false;
+	size_t target = next_power_of_2(_length + header_size);
+	if (target > arena->total_size)
+		return false;
+
+	for (size_t s = size; s < target; s *= 2)
+	{
+		BlockHeader* buddy = (BlockHeader*) ((uintptr_t) block ^ s);
+		if (buddy < block || !buddy_is_free(arena, buddy, get_depth(s)))
+			return false;
+	}
+
+	for (size_t s = size; s < target; s *= 2)
+	{
+		remove_free(arena, (BlockHeader*) ((uintptr_t) block ^ s), get_depth(s));
+		++merges;
+	}
+
+	if (arena->block_info != nullptr)
+		set_block_info(arena, block, get_depth(target), false);
+	else
+		block->block_size = target;
+	return true;
+}
+
+size_t BuddyAllocator::block_size_of(Arena* arena, char* _a)
+{ // Returns the size of the buddy block behind a user pointer without touching user memory
+	if (arena->block_info == nullptr)
+		return header_of(arena, _a)->block_size;
+	return (size_t) basic_block_size << (arena->block_info[(_a - arena->base_addr) / basic_block_size] & ~BLOCK_FREE);
+}
+
+bool BuddyAllocator::start_trace(const char* path)
+{ // Attaches a recorder writing to path, replacing any earlier one
+	stop_trace();
+	recorder = TraceRecorder::create(path);
+	return recorder != nullptr;
+}
+
+void BuddyAllocator::stop_trace()
+{ // Detaches the recorder and closes its file
+	if (recorder == nullptr)
+		return;
+	TraceRecorder* done = recorder;
+	recorder = nullptr;
+	TraceRecorder::destroy(done);
+}
+
+void BuddyAllocator::flush_trace()
+{
+	if (recorder != nullptr)
+		recorder->flush();
+}
+
+size_t BuddyAllocator::usable_size(char* _a)
+{ // Returns how many bytes the caller may use at _a
+	Arena* arena = arena_of(_a);
+	if (arena == nullptr)
+		return 0;
+
+	if (options & BA_SLAB)
+	{
+		size_t page = (_a - arena->base_addr) / slab_page_size;
+		if (arena->slab_map[page] != 0)
+			return slab_classes[arena->slab_map[page] - 1].object_size;
+	}
+
+	if (arena->block_info == nullptr)
+	{ // An aligned pointer may start further into its block than right after the header
+		BlockHeader* block = header_of(arena, _a);
+		return block->block_size - (_a - (char*) block);
+	}
+	return block_size_of(arena, _a);
+}
+
+char* BuddyAllocator::slab_alloc(uint _length)
+{ // Hands out an object of the smallest size class that fits, carving a new slab page if needed
+	uint c = slab_class_index[(_length + SLAB_ALIGN - 1) / SLAB_ALIGN];
+	SlabClass* sc = &slab_classes[c];
+	if (options & BA_CONCURRENT)
+		pthread_mutex_lock(&sc->lock);
+	SlabHeader* slab = sc->partial;
+
+	if (slab == nullptr)
+	{ // No slab of this class has room left, take a new page from the buddy tree
+		if (options & BA_CONCURRENT)
+			pthread_mutex_lock(&mtx);
+		BlockHeader* block = alloc_block(get_depth(slab_page_size));
+		if (options & BA_CONCURRENT)
+			pthread_mutex_unlock(&mtx);
+		if (block == nullptr)
+		{
+			if (options & BA_CONCURRENT)
+				pthread_mutex_unlock(&sc->lock);
+			return nullptr;
+		}
+
+		slab = new ((char*) block + header_size) SlabHeader();
+		slab->size_class = c;
+		slab->unused = (char*) block + slab_object_offset;
+		slab->end = slab->unused + (slab_page_size - slab_object_offset) / sc->object_size * sc->object_size;
+
+		Arena* arena = arena_of((char*) block);
+		arena->slab_map[((char*) block - arena->base_addr) / slab_page_size] = c + 1;
+		sc->partial = slab;
+		sc->pages++;
+	}
+
+	char* mem;
+	if (slab->free_objects != nullptr)
+	{
+		mem = slab->free_objects;
+		slab->free_objects = *(char**) mem;
+	}
+	else
+	{
+		mem = slab->unused;
+		slab->unused += sc->object_size;
+	}
+	slab->in_use++;
+
+	if (slab->free_objects == nullptr && slab->unused == slab->end)
+	{ // Full slabs leave the partial list until one of their objects is freed
+		sc->partial = slab->next;
+		if (slab->next != nullptr)
+			slab->next->prev = nullptr;
+		slab->next = nullptr;
+	}
+
+	sc->allocations++;
+	sc->requested_bytes += _length;
+	if (options & BA_CONCURRENT)
+		pthread_mutex_unlock(&sc->lock);
+	return mem;
+}
+
+void BuddyAllocator::slab_free(char* _a, Arena* arena, size_t page)
+{ // Returns an object to its slab, giving the page back to the buddy tree once it is empty
+	BlockHeader* block = (BlockHeader*) (arena->base_addr + page * slab_page_size);
+	SlabHeader* slab = (SlabHeader*) ((char*) block + header_size);
+	SlabClass* sc = &slab_classes[slab->size_class];
+	if (options & BA_CONCURRENT)
+		pthread_mutex_lock(&sc->lock);
+
+	bool was_full = (slab->free_objects == nullptr && slab->unused == slab->end);
+
+	*(char**) _a = slab->free_objects;
+	slab->free_objects = _a;
+	slab->in_use--;
+
+	if (was_full)
+	{ // The slab has room again
+		slab->prev = nullptr;
+		slab->next = sc->partial;
+		if (sc->partial != nullptr)
+			sc->partial->prev = slab;
+		sc->partial = slab;
+	}
+
+	if (slab->in_use == 0 && (slab->prev != nullptr || slab->next != nullptr))
+	{ // Keep one empty slab per class around to avoid thrashing, release any others
+		if (slab->prev != nullptr)
+			slab->prev->next = slab->next;
+		else
+			sc->partial = slab->next;
+		if (slab->next != nullptr)
+			slab->next->prev = slab->prev;
+
+		arena->slab_map[page] = 0;
+		sc->pages--;
+		block->block_size = slab_page_size; // without in-band headers this overwrites the (now unused) SlabHeader
+		if (options & BA_CONCURRENT)
+			pthread_mutex_lock(&mtx);
+		free_block(block);
+		if (options & BA_CONCURRENT)
+			pthread_mutex_unlock(&mtx);
+	}
+	if (options & BA_CONCURRENT)
+		pthread_mutex_unlock(&sc->lock);
 }
 
 BlockHeader* BuddyAllocator::getbuddy(BlockHeader* addr)
 { // given a block address, this function returns the address of its buddy
-	return (BlockHeader*) ((((char*) addr - base_addr) ^ addr->block_size) + base_addr);
+	// (arenas are aligned to their own size, so the offset XOR can be done on the address itself)
+	return (BlockHeader*) ((uintptr_t) addr ^ addr->block_size);
 }
 
 bool BuddyAllocator::arebuddies(BlockHeader* block1, BlockHeader* block2)
@@ -158,7 +1016,7 @@ bool BuddyAllocator::arebuddies(BlockHeader* block1, BlockHeader* block2)
 	return true;
 }
 
-BlockHeader* BuddyAllocator::merge(BlockHeader* block1, BlockHeader* block2)
+BlockHeader* BuddyAllocator::merge(Arena* arena, BlockHeader* block1, BlockHeader* block2)
 { /* This function merges the two blocks returns the beginning address of the merged block.
      (note that either block1 can be to the left of block2, or the other way around)
   */
@@ -175,26 +1033,27 @@ BlockHeader* BuddyAllocator::merge(BlockHeader* block1, BlockHeader* block2)
 		return nullptr;
 	}
 
-	uint depth = log2(block1->block_size / basic_block_size);
+	uint depth = get_depth(block1->block_size);
 
 	// Remove the blocks from the current free list, and add the first block to the next free list
-	free_list[depth].remove(block1);
-	free_list[depth].remove(block2);
+	remove_free(arena, block1, depth);
+	remove_free(arena, block2, depth);
 
 	block1->block_size *= 2;
 
-	free_list[depth + 1].insert(block1);
+	insert_free(arena, block1, depth + 1);
+	++merges;
 	
 	return block1;
 }
 
-BlockHeader* BuddyAllocator::split(BlockHeader* block)
+BlockHeader* BuddyAllocator::split(Arena* arena, BlockHeader* block)
 { /* Splits the given block by putting a new header halfway through the block.
      Also, the original header needs to be corrected.
   */
  	//printf("\nSPLIT\n"); //DEBUG
 
- 	uint depth = log2(block->block_size / basic_block_size);
+ 	uint depth = get_depth(block->block_size);
 
 	if (depth < 1)
 	{
@@ -203,7 +1062,7 @@ BlockHeader* BuddyAllocator::split(BlockHeader* block)
 	}
 
 	// Remove block from free list
- 	free_list[depth].remove(block);
+ 	remove_free(arena, block, depth);
 
  	block->block_size /= 2;
 
@@ -213,15 +1072,272 @@ BlockHeader* BuddyAllocator::split(BlockHeader* block)
 	new_header->free = true;
 
 	// Insert both BlockHeaders into the previous free list
-	free_list[depth - 1].insert(block);
-	free_list[depth - 1].insert(new_header);
+	insert_free(arena, block, depth - 1);
+	insert_free(arena, new_header, depth - 1);
+	++splits;
  	return new_header;
 }
 
 void BuddyAllocator::debug()
-{ // Prints each level size and number of free blocks of each size
+{ // Prints each level size and number of free blocks of each size (summed over all arenas)
+	uint max_depth = 0;
+	for (Arena* arena = arenas; arena != nullptr; arena = arena->next)
+	{
+		if (arena->max_depth > max_depth)
+			max_depth = arena->max_depth;
+	}
+
 	for (uint i = 0; i <= max_depth; ++i)
 	{
-		printf("%u: %u\n", (unsigned) (basic_block_size * pow(2, i)), free_list[i].get_size());
+		uint count = 0;
+		for (Arena* arena = arenas; arena != nullptr; arena = arena->next)
+		{
+			if (i <= arena->max_depth)
+				count += arena->free_list[i].get_size();
+		}
+		printf("%zu: %u\n", (size_t) basic_block_size << i, count);
+	}
+}
+
+void BuddyAllocator::lock_for_stats()
+{ // Takes every slab class lock in order, then mtx, so the slab and buddy counters hold still while summed
+	if (!(options & BA_CONCURRENT))
+		return;
+	if (options & BA_SLAB)
+	{
+		for (uint c = 0; c < SLAB_CLASSES; ++c)
+			pthread_mutex_lock(&slab_classes[c].lock);
+	}
+	pthread_mutex_lock(&mtx);
+}
+
+void BuddyAllocator::unlock_for_stats()
+{
+	if (!(options & BA_CONCURRENT))
+		return;
+	pthread_mutex_unlock(&mtx);
+	if (options & BA_SLAB)
+	{
+		for (uint c = SLAB_CLASSES; c-- > 0;)
+			pthread_mutex_unlock(&slab_classes[c].lock);
+	}
+}
+
+static void add_usage(UsageCounters& sum, UsageCounters& counters)
+{ // The owners of the counters keep counting meanwhile, hence the atomic loads
+	sum.buddy_allocations += __atomic_load_n(&counters.buddy_allocations, __ATOMIC_RELAXED);
+	sum.buddy_requested_bytes += __atomic_load_n(&counters.buddy_requested_bytes, __ATOMIC_RELAXED);
+	sum.buddy_consumed_bytes += __atomic_load_n(&counters.buddy_consumed_bytes, __ATOMIC_RELAXED);
+	sum.frees += __atomic_load_n(&counters.frees, __ATOMIC_RELAXED);
+	sum.failed_allocations += __atomic_load_n(&counters.failed_allocations, __ATOMIC_RELAXED);
+}
+
+UsageCounters BuddyAllocator::read_usage()
+{ // Sums the shared counters and those of every live thread cache (callers hold mtx in concurrent mode)
+	UsageCounters sum;
+	add_usage(sum, usage);
+	for (ThreadCache* cache = caches; cache != nullptr; cache = cache->next)
+		add_usage(sum, cache->usage);
+	return sum;
+}
+
+BuddyStats BuddyAllocator::stats()
+{ // Adds up the free list sizes of every arena and the counters of every thread under one short lock
+	BuddyStats st;
+
+	lock_for_stats();
+	for (Arena* arena = arenas; arena != nullptr; arena = __atomic_load_n(&arena->next, __ATOMIC_ACQUIRE))
+	{
+		st.total_bytes += arena->total_size;
+		if (arena->max_depth + 1 > st.orders)
+			st.orders = arena->max_depth + 1;
+		for (unsigned long long orders = arena->free_orders; orders != 0; orders &= orders - 1)
+		{ // Only orders with a non-empty list contribute
+			uint depth = __builtin_ctzll(orders);
+			size_t block_size = (size_t) basic_block_size << depth;
+			uint count = arena->free_list[depth].get_size();
+			st.free_blocks_per_order[depth] += count;
+			st.free_bytes_per_order[depth] += count * block_size;
+			st.free_bytes += count * block_size;
+			if (block_size > st.largest_free_block)
+				st.largest_free_block = block_size;
+		}
+	}
+
+	UsageCounters counters = read_usage();
+	for (ThreadCache* cache = caches; cache != nullptr; cache = cache->next)
+	{
+		for (uint i = 0; i < MAGAZINE_ORDERS; ++i)
+			st.bytes_cached += (size_t) __atomic_load_n(&cache->count[i], __ATOMIC_RELAXED) * (basic_block_size << i);
+	}
+	st.allocations = counters.buddy_allocations;
+	for (uint c = 0; c < SLAB_CLASSES; ++c)
+	{
+		st.allocations += slab_classes[c].allocations;
 	}
+	st.frees = counters.frees;
+	st.failed_allocations = counters.failed_allocations;
+	st.splits = splits;
+	st.merges = merges;
+	unlock_for_stats();
+
+	st.bytes_in_use = st.total_bytes - st.free_bytes;
+	st.external_fragmentation = (st.free_bytes > 0) ? 1.0 - (double) st.largest_free_block / st.free_bytes : 0.0;
+	return st;
+}
+
+void BuddyAllocator::usage_report(FILE* out)
+{ // Prints bytes requested versus bytes consumed for each slab class and for the buddy path
+	UsageCounters buddy;
+	SlabClass classes[SLAB_CLASSES];
+
+	// Snapshot the counters first: printing may allocate, and this allocator may be malloc
+	lock_for_stats();
+	buddy = read_usage();
+	for (uint c = 0; c < SLAB_CLASSES; ++c)
+	{
+		classes[c] = slab_classes[c];
+	}
+	unlock_for_stats();
+
+	unsigned long long total_requested = buddy.buddy_requested_bytes;
+	unsigned long long total_consumed = buddy.buddy_consumed_bytes;
+
+	fprintf(out, "%10s %8s %14s %14s %14s %10s\n", "class", "pages", "allocations", "requested", "consumed", "efficiency");
+	if (options & BA_SLAB)
+	{
+		for (uint c = 0; c < SLAB_CLASSES; ++c)
+		{
+			SlabClass* sc = &classes[c];
+			unsigned long long consumed = sc->allocations * sc->object_size;
+			if (sc->allocations == 0)
+				continue;
+			fprintf(out, "%10u %8u %14llu %14llu %14llu %9.1f%%\n", sc->object_size, sc->pages, sc->allocations,
+				sc->requested_bytes, consumed, 100.0 * sc->requested_bytes / consumed);
+			total_requested += sc->requested_bytes;
+			total_consumed += consumed;
+		}
+	}
+
+	fprintf(out, "%10s %8s %14llu %14llu %14llu %9.1f%%\n", "buddy", "-", buddy.buddy_allocations, buddy.buddy_requested_bytes,
+		buddy.buddy_consumed_bytes, buddy.buddy_consumed_bytes ? 100.0 * buddy.buddy_requested_bytes / buddy.buddy_consumed_bytes : 0.0);
+	fprintf(out, "%10s %8s %14s %14llu %14llu %9.1f%%\n", "total", "-", "", total_requested, total_consumed,
+		total_consumed ? 100.0 * total_requested / total_consumed : 0.0);
+}
+
+uint BuddyAllocator::get_depth(size_t size)
+{ // Returns the free list index for a block size (both sizes are powers of two, so this is a shift difference)
+	return log2_pow2(size) - log2_pow2(basic_block_size);
+}
+
+void BuddyAllocator::insert_free(Arena* arena, BlockHeader* block, uint depth)
+{ // Adds a block to free_list[depth] and marks that order as non-empty
+	arena->free_list[depth].insert(block);
+	arena->free_orders |= 1ULL << depth;
+	set_block_info(arena, block, depth, true);
+}
+
+void BuddyAllocator::remove_free(Arena* arena, BlockHeader* block, uint depth)
+{ // Removes a block from free_list[depth] and clears the order's bit once the list runs dry
+	arena->free_list[depth].remove(block);
+	if (arena->free_list[depth].get_size() == 0)
+		arena->free_orders &= ~(1ULL << depth);
+}
+
+void BuddyAllocator::set_block_info(Arena* arena, BlockHeader* block, uint depth, bool free)
+{ // Records a block's order and state in the side table (only kept with BA_NO_HEADER)
+	if (arena->block_info != nullptr)
+		arena->block_info[((char*) block - arena->base_addr) / basic_block_size] = depth | (free ? BLOCK_FREE : 0);
+}
+
+bool BuddyAllocator::buddy_is_free(Arena* arena, BlockHeader* buddy, uint depth)
+{ // Checks whether a buddy is a free block of the given depth without trusting memory a user may own
+	if (arena->block_info != nullptr)
+		return arena->block_info[((char*) buddy - arena->base_addr) / basic_block_size] == (depth | BLOCK_FREE);
+	return buddy->free && buddy->block_size == ((size_t) basic_block_size << depth);
+}
+
+BlockHeader* BuddyAllocator::header_of(Arena* arena, char* _a)
+{ // Returns the block behind a user pointer with its block_size filled in
+	if (arena->block_info == nullptr)
+	{
+		BlockHeader* block = (BlockHeader*) (_a - sizeof(BlockHeader));
+		if (block->block_size == 0) // shadow header of an alloc_aligned() pointer
+			block = block->next;
+		return block;
+	}
+
+	// Without in-band headers the block starts at the user pointer. The user is done with
+	// the memory, so the size from the side table can be written back into the free list node.
+	BlockHeader* block = (BlockHeader*) _a;
+	block->block_size = (size_t) basic_block_size << (arena->block_info[(_a - arena->base_addr) / basic_block_size] & ~BLOCK_FREE);
+	return block;
+}
+
+Arena* BuddyAllocator::create_arena(size_t size)
+{ // Maps a new arena aligned to its own size, with its free lists and side tables in a second mapping
+	uint max_depth = get_depth(size);
+	size_t list_bytes = sizeof(LinkedList) * (max_depth + 1);
+	size_t info_bytes = (options & BA_NO_HEADER) ? size / basic_block_size : 0;
+	size_t slab_bytes = (options & BA_SLAB) ? size / slab_page_size : 0;
+	size_t metadata_size = sizeof(Arena) + list_bytes + info_bytes + slab_bytes;
+
+	char* metadata = (char*) mmap(NULL, metadata_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (metadata == MAP_FAILED)
+		return nullptr;
+
+	// Over-reserve so a size-aligned window can be cut out, then trim both ends
+	char* raw = (char*) mmap(NULL, 2 * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (raw == MAP_FAILED)
+	{
+		munmap(metadata, metadata_size);
+		return nullptr;
+	}
+	char* base = (char*) (((uintptr_t) raw + size - 1) & ~(uintptr_t) (size - 1));
+	if (base > raw)
+		munmap(raw, base - raw);
+	if (base + size < raw + 2 * size)
+		munmap(base + size, raw + 2 * size - (base + size));
+
+	// Anonymous mappings start zeroed, so the side tables need no initialization
+	Arena* arena = new (metadata) Arena();
+	arena->base_addr = base;
+	arena->total_size = size;
+	arena->max_depth = max_depth;
+	arena->metadata_size = metadata_size;
+	arena->free_list = (LinkedList*) (metadata + sizeof(Arena));
+	for (uint i = 0; i <= max_depth; ++i)
+	{
+		new (&arena->free_list[i]) LinkedList();
+	}
+	if (info_bytes > 0)
+		arena->block_info = (unsigned char*) metadata + sizeof(Arena) + list_bytes;
+	if (slab_bytes > 0)
+		arena->slab_map = (unsigned char*) metadata + sizeof(Arena) + list_bytes + info_bytes;
+
+	// Add BlockHeader to beginning of block and insert into free_list
+	BlockHeader* base_head = (BlockHeader*) base;
+	base_head->block_size = size;
+	base_head->free = true;
+	insert_free(arena, base_head, max_depth);
+
+	return arena;
+}
+
+Arena* BuddyAllocator::arena_of(char* _a)
+{ // Returns the arena containing an address, or nullptr if it is not ours
+	for (Arena* arena = arenas; arena != nullptr; arena = __atomic_load_n(&arena->next, __ATOMIC_ACQUIRE))
+	{
+		if (_a >= arena->base_addr && _a < arena->base_addr + arena->total_size)
+			return arena;
+	}
+	return nullptr;
+}
+
+void BuddyAllocator::release_pages(BlockHeader* block)
+{ // Tells the OS it may drop the pages of a free block, keeping the page that holds its header
+	uintptr_t start = ((uintptr_t) block + sizeof(BlockHeader) + page_size - 1) & ~(uintptr_t) (page_size - 1);
+	uintptr_t end = (uintptr_t) block + block->block_size;
+	if (start < end)
+		madvise((void*) start, end - start, MADV_DONTNEED);
 }
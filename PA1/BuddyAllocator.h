@@ -14,9 +14,31 @@
 #define _BuddyAllocator_h_
 
 #include <iostream>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "Trace.h"
 using namespace std;
 typedef unsigned int uint;
 
+#define MAGAZINE_ORDERS 8	// smallest block orders that are cached per thread in concurrent mode
+#define MAGAZINE_SIZE 32	// maximum number of cached blocks per order and thread
+
+#define SLAB_PAGE_SIZE 4096	// size of the buddy blocks that slabs are carved out of
+#define SLAB_MAX_SIZE 512	// largest request served by the slab front end
+#define SLAB_CLASSES 16		// number of slab size classes (see slab_class_sizes)
+#define SLAB_ALIGN 16		// every slab object is aligned to this many bytes
+
+// option flags passed to the BuddyAllocator constructor
+enum BUDDY_OPTIONS {BA_DEFAULT = 0, BA_CONCURRENT = 1, BA_SLAB = 2, BA_NO_HEADER = 4, BA_QUIET = 8, BA_LAZY = 16};
+
+#define BLOCK_FREE 0x80		// side table flag for free blocks, the low bits hold the block's depth
+
+#define RELEASE_THRESHOLD (1 << 20)	// free blocks at least this large have their pages handed back to the OS
+
+#define MAX_ORDERS 64		// block orders an arena can have (free_orders is a 64-bit mask)
+#define MAX_BLOCK_SIZE ((size_t) 1 << 62)	// largest block; bigger requests fail before rounding up could wrap to 0
+
 /* declare types as you need */
 
 struct BlockHeader
@@ -24,7 +46,8 @@ struct BlockHeader
 	// decide what goes here
 	// hint: obviously block size will go here
 	BlockHeader* next = nullptr;
-	uint block_size = 0;
+	BlockHeader* prev = nullptr;	// free lists are doubly linked so a block can be unlinked in O(1)
+	size_t block_size = 0;
 	bool free = true;
 };
 
@@ -38,14 +61,16 @@ private:
 public:
 	void insert (BlockHeader* b)
 	{	// adds a block to the front of a linked list
-		BlockHeader* temp = head;
+		b->prev = nullptr;
+		b->next = head;
+		if (head != nullptr)
+			head->prev = b;
 		head = b;
-		b->next = temp;
 		size++;
 	}
 
 	void remove (BlockHeader* b)
-	{   // removes a particular block from the list
+	{   // removes a particular block from the list in constant time
 
 		if (size == 0)
 		{
@@ -53,27 +78,22 @@ public:
 			return;
 		}
 
-		if (head == b)
-		{ // If removing the head
+		if (b->prev != nullptr)
+			b->prev->next = b->next;
+		else if (head == b)
 			head = b->next;
-			size--;
+		else
+		{
+			cout << "ERROR: Could not find memory block for list removal!\n";
 			return;
 		}
 
-		// Otherwise loop through list to find block
-		BlockHeader* it = head;
-		while(it->next != nullptr)
-		{
-			if (it->next == b)
-			{
-				it->next = b->next;
-				size--;
-				return;
-			}
-			it = it->next;
-		}
+		if (b->next != nullptr)
+			b->next->prev = b->prev;
 
-		cout << "ERROR: Could not find memory block for list removal!\n";
+		b->next = nullptr;
+		b->prev = nullptr;
+		size--;
 	}
 
 	BlockHeader* get_head()
@@ -87,16 +107,118 @@ public:
 	}
 };
 
+struct SlabHeader
+{
+	// sits right after the BlockHeader of a buddy block of SLAB_PAGE_SIZE bytes that has been
+	// carved into equally sized objects of one size class
+	SlabHeader* next = nullptr;		// partial slabs of a class are kept on a doubly linked list
+	SlabHeader* prev = nullptr;
+	char* free_objects = nullptr;	// objects that were freed, chained through their first word
+	char* unused = nullptr;			// next never-handed-out object (objects are carved lazily)
+	char* end = nullptr;			// end of the last object that fits in the page
+	uint size_class = 0;
+	uint in_use = 0;
+};
+
+struct SlabClass
+{
+	uint object_size = 0;
+	SlabHeader* partial = nullptr;	// slabs of this class with at least one free object
+	uint pages = 0;					// slab pages currently owned by this class
+	pthread_mutex_t lock;			// guards the class and its slabs in concurrent mode (taken before mtx)
+	unsigned long long allocations = 0;
+	unsigned long long requested_bytes = 0;
+};
+
+struct UsageCounters
+{
+	// cumulative bytes asked for versus bytes actually reserved by the buddy path,
+	// plus operation counts that are not kept anywhere else
+	unsigned long long buddy_allocations = 0;
+	unsigned long long buddy_requested_bytes = 0;
+	unsigned long long buddy_consumed_bytes = 0;
+	unsigned long long frees = 0;
+	unsigned long long failed_allocations = 0;
+};
+
+struct BuddyStats
+{
+	// snapshot returned by BuddyAllocator::stats(). Order i holds blocks of basic_block_size << i.
+	size_t total_bytes = 0;			// bytes in all arenas
+	size_t bytes_in_use = 0;		// not on a free list: handed out, slab pages and thread magazines
+	size_t bytes_cached = 0;		// part of bytes_in_use parked in thread magazines
+	size_t free_bytes = 0;
+	size_t free_bytes_per_order[MAX_ORDERS] = {};
+	uint free_blocks_per_order[MAX_ORDERS] = {};
+	uint orders = 0;				// valid entries in the per-order arrays
+	size_t largest_free_block = 0;
+	double external_fragmentation = 0;	// 1 - largest_free_block / free_bytes (0 when nothing is free);
+										// with BA_LAZY unmerged buddies count as fragmented
+
+	unsigned long long allocations = 0;	// successful alloc() calls, slab and buddy
+	unsigned long long frees = 0;
+	unsigned long long splits = 0;
+	unsigned long long merges = 0;		// including buddies absorbed by an in-place realloc
+	unsigned long long failed_allocations = 0;
+};
+
+struct Arena
+{
+	// one mmap'ed, size-aligned region with its own buddy tree. When every arena is exhausted
+	// a new one is chained on; arenas stay mapped until the allocator is destroyed, but large
+	// free blocks inside them give their pages back with madvise.
+	char* base_addr = nullptr;
+	size_t total_size = 0;
+	uint max_depth = 0;
+	LinkedList* free_list = nullptr;
+	unsigned long long free_orders = 0;		// bit i is set while free_list[i] is non-empty
+	unsigned char* block_info = nullptr;	// BA_NO_HEADER: depth | BLOCK_FREE for each basic block that starts a block
+	unsigned char* slab_map = nullptr;		// BA_SLAB: one entry per slab page of the arena: class + 1, or 0
+	size_t metadata_size = 0;				// this struct and its tables share one mapping
+	Arena* next = nullptr;
+};
+
+class BuddyAllocator;
+
+struct ThreadCache
+{
+	// per-thread magazines of allocated-but-unused blocks, one stack per small order.
+	// cached blocks stay marked as in use so the buddy tree never merges them.
+	BuddyAllocator* owner = nullptr;
+	ThreadCache* next = nullptr;
+	ThreadCache* prev = nullptr;
+	BlockHeader* blocks[MAGAZINE_ORDERS][MAGAZINE_SIZE];
+	uint count[MAGAZINE_ORDERS] = {};
+	UsageCounters usage;			// allocations served through this thread's magazines
+	// stats() reads count and usage from other threads, so the owner writes them atomically
+	// outside of refill and flush (which hold mtx)
+};
 
 class BuddyAllocator
 {
 private:
 	/* declare member variables as necessary */
-	LinkedList* free_list = nullptr;
-	char* base_addr = nullptr;
+	Arena* arenas = nullptr;		// chained in creation order, the first one is searched first
+	Arena* last_arena = nullptr;
 	uint basic_block_size = 0;
-	uint total_size = 0;
-	uint max_depth = 0;
+	size_t total_size = 0;			// size of a regular arena (larger requests get a dedicated one)
+	size_t page_size = 4096;
+	int options = BA_DEFAULT;
+	uint header_size = sizeof(BlockHeader);	// bytes in front of every user pointer (0 with BA_NO_HEADER)
+
+	pthread_mutex_t mtx;			// guards the buddy tree in concurrent mode
+	pthread_key_t cache_key;		// per-thread ThreadCache in concurrent mode
+	ThreadCache* caches = nullptr;	// every live ThreadCache, so the destructor can release them
+	UsageCounters usage;			// allocations served without a thread cache (and exited threads)
+	unsigned long long splits = 0;	// buddy tree operations (guarded by mtx in concurrent mode)
+	unsigned long long merges = 0;
+
+	SlabClass slab_classes[SLAB_CLASSES];
+	unsigned char slab_class_index[SLAB_MAX_SIZE / SLAB_ALIGN + 1];	// request size / SLAB_ALIGN -> class
+	uint slab_page_size = 0;
+	uint slab_object_offset = 0;	// offset of the first object from the start of a slab page
+
+	TraceRecorder* recorder = nullptr;	// set while alloc/free are being recorded
 
 private:
 	/* private function you are required to implement
@@ -108,22 +230,93 @@ private:
 	bool arebuddies(BlockHeader* block1, BlockHeader* block2);
 	// checks whether the two blocks are buddies are not
 
-	BlockHeader* merge(BlockHeader* block1, BlockHeader* block2);
+	BlockHeader* merge(Arena* arena, BlockHeader* block1, BlockHeader* block2);
 	// this function merges the two blocks returns the beginning address of the merged block
 	// note that either block1 can be to the left of block2, or the other way around
 
-	BlockHeader* split(BlockHeader* block);
+	BlockHeader* split(Arena* arena, BlockHeader* block);
 	// splits the given block by putting a new header halfway through the block
 	// also, the original header needs to be corrected
 
+	uint get_depth(size_t size);
+	// returns the free list index for a (power of two) block size
+
+	void insert_free(Arena* arena, BlockHeader* block, uint depth);
+	void remove_free(Arena* arena, BlockHeader* block, uint depth);
+	// add/remove a block on free_list[depth] while keeping free_orders in sync
+
+	void set_block_info(Arena* arena, BlockHeader* block, uint depth, bool free);
+	bool buddy_is_free(Arena* arena, BlockHeader* buddy, uint depth);
+	BlockHeader* header_of(Arena* arena, char* _a);
+	// metadata access that works with and without in-band headers
+
+	Arena* create_arena(size_t size);
+	Arena* arena_of(char* _a);
+	void release_pages(BlockHeader* block);
+	bool grow_in_place(Arena* arena, char* _a, size_t _length);
+	size_t block_size_of(Arena* arena, char* _a);
+	// arena management: map a new size-aligned arena, find the arena owning a pointer,
+	// and hand the pages of a large free block back to the OS; plus realloc helpers
+
+	char* alloc_memory(size_t _length);
+	char* alloc_buddy(size_t _length);
+	int free_memory(char* _a);
+	// the work behind alloc() and free(), which additionally record the call when tracing
+	// (alloc_buddy skips the slab front end)
+
+	uint carve(Arena* arena, BlockHeader* block, uint order, uint depth, uint count, char** _out);
+	void free_run(Arena* arena, BlockHeader* start, uint count);
+	// batch helpers: cut an allocated block into blocks of a smaller depth, and free neighbouring
+	// blocks as aligned chunks (callers hold mtx in concurrent mode)
+
+	BlockHeader* alloc_block(uint depth);
+	void free_block(BlockHeader* block);
+	// take a block out of/return a block to the buddy tree (callers hold mtx in concurrent mode)
+
+	bool coalesce(Arena* arena, uint depth);
+	// BA_LAZY: merges every free buddy pair below depth, returns whether a block of depth or more is now free
+
+	ThreadCache* get_thread_cache();
+	UsageCounters* thread_usage();
+	void refill_magazine(ThreadCache* cache, uint depth);
+	void flush_magazine(ThreadCache* cache, uint depth, uint keep);
+	void flush_thread_cache(ThreadCache* cache, uint keep);
+	static void release_thread_cache(void* cache);
+	// per-thread magazine management for concurrent mode (get_thread_cache returns nullptr if the
+	// magazines cannot be mapped; callers then fall back to the locked buddy tree and shared counters)
+
+	void tally(unsigned long long& counter, unsigned long long n = 1);
+	// bumps a usage counter, atomically in concurrent mode where stats() may be reading it
+
+	void lock_for_stats();
+	void unlock_for_stats();
+	UsageCounters read_usage();
+	// stats and usage_report: take every class lock, then mtx; sum the usage counters of all threads
+
+	char* slab_alloc(uint _length);
+	void slab_free(char* _a, Arena* arena, size_t page);
+	// small-object front end used with BA_SLAB (each takes its class lock, then mtx only to get or return a page)
+
 
 public:
-	BuddyAllocator (int _basic_block_size, int _total_memory_length); 
+	BuddyAllocator (int _basic_block_size, size_t _total_memory_length, int _options = BA_DEFAULT); 
 	/* This initializes the memory allocator and makes a portion of 
 	   ’_total_memory_length’ bytes available. The allocator uses a ’_basic_block_size’ as 
 	   its minimal unit of allocation. The function returns the amount of 
 	   memory made available to the allocator. If an error occurred, 
 	   it returns 0. 
+	   '_options' is a mask of BUDDY_OPTIONS. With BA_CONCURRENT, alloc and free may be
+	   called from several threads; each thread keeps magazines of recently freed small
+	   blocks and only takes the allocator lock on a miss. With BA_NO_HEADER, block order
+	   and free state live in a side table (one byte per basic block) instead of in front
+	   of the user pointer, so pointers are aligned to their block size and a power of two
+	   request fits a block of exactly that size.
+	   Memory is reserved with mmap and only committed as it is touched. When an arena runs
+	   out (or a request is larger than it), another one is chained on. BA_QUIET suppresses
+	   all diagnostic output (needed when the allocator stands in for malloc). With BA_LAZY,
+	   free() leaves blocks unmerged on their own order's list, where the next alloc() of
+	   that order finds them without splitting; buddies are only merged, a whole arena at a
+	   time, when no free block is large enough for a request.
 	*/ 
 
 	~BuddyAllocator(); 
@@ -131,13 +324,48 @@ public:
 	   There should not be any memory leakage (i.e., memory staying allocated).
 	*/ 
 
-	char* alloc(int _length); 
+	char* alloc(size_t _length); 
 	/* Allocate _length number of bytes of free memory and returns the 
 		address of the allocated portion. Returns 0 when out of memory. */ 
 
 	int free(char* _a); 
 	/* Frees the section of physical memory previously allocated 
 	   using ’my_malloc’. Returns 0 if everything ok. */ 
+
+	char* realloc(char* _a, size_t _length);
+	/* Resizes an allocation. A buddy block grows in place when its right-hand buddies are
+	   free; otherwise the data moves to a new allocation. Returns nullptr (leaving _a
+	   untouched) when out of memory. */
+
+	size_t usable_size(char* _a);
+	/* Returns the number of bytes usable at an address returned by alloc(). */
+
+	char* alloc_aligned(size_t _length, size_t _alignment);
+	/* Like alloc(), but the address is a multiple of _alignment (a power of two). The block is
+	   chosen large enough to be aligned itself; with block headers, the data starts _alignment
+	   bytes into it behind a shadow header that leads free() back to the real one. Free the
+	   result with free(). */
+
+	uint alloc_batch(size_t _length, uint _count, char** _out);
+	/* Allocates _count objects of _length bytes into _out under a single lock, carving them out
+	   of as few large blocks as possible. Returns how many were allocated (all of them unless
+	   memory ran out). */
+
+	uint free_batch(char** _ptrs, uint _count);
+	/* Frees _count objects under a single lock, returning runs of neighbouring blocks to the
+	   buddy tree in aligned chunks. Sorts _ptrs by address. Returns how many were freed. */
+
+	bool start_trace(const char* path);
+	/* Starts recording every alloc() and free() (a realloc counts as a free followed by an
+	   alloc) to a binary trace file (see Trace.h). Call it before other threads use the
+	   allocator. Returns false if the file cannot be created. */
+
+	void stop_trace();
+	/* Stops recording and closes the trace file (no other thread may be using the allocator).
+	   The destructor does this as well. */
+
+	void flush_trace();
+	/* Writes out the records buffered so far while recording continues. */
    
 	void debug();
 	/* Mainly used for debugging purposes and running short test cases */
@@ -151,6 +379,15 @@ public:
 	....
 	....
 	 which means that at point, the allocator has 5 128 byte blocks, 3 512 byte blocks and so on.*/
+
+	BuddyStats stats();
+	/* Returns occupancy, per-order free space, fragmentation and operation counters. The
+	   counters are maintained on the fly, so this only walks the arenas' free list sizes
+	   (not the lists). In concurrent mode it may be polled from any thread. */
+
+	void usage_report(FILE* out = stdout);
+	/* Prints, per slab size class and for the buddy path, how many allocations were made,
+	   how many bytes were requested and how many bytes those requests actually consumed. */
 };
 
 #endif 
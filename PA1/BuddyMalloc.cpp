@@ -0,0 +1,178 @@
+/*
+    File: BuddyMalloc.cpp
+
+    Routes the C allocation functions through one global BuddyAllocator so that
+    unmodified programs can be run on top of it:
+
+        LD_PRELOAD=./libbuddymalloc.so ./client -n 15000 -p 15 -w 100
+
+    The allocator runs in concurrent, header-free, slab mode so that pointers
+    are at least 16-byte aligned like glibc's. Its geometry can be changed with
+    the BUDDY_BLOCK_SIZE and BUDDY_ARENA_SIZE environment variables,
+    BUDDY_REPORT=1 prints the usage report to stderr when the program exits, and
+    BUDDY_TRACE=<file> records every allocation to a trace for allocbench -i.
+*/
+
+#include "BuddyAllocator.h"
+#include <errno.h>
+#include <new>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+using namespace std;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static BuddyAllocator* global_allocator = nullptr;
+alignas(BuddyAllocator) static char allocator_storage[sizeof(BuddyAllocator)]; // no malloc before malloc exists
+
+static void init_allocator()
+{ // Builds the global allocator in static storage (nothing in here may call malloc)
+	int basic_block_size = sizeof(BlockHeader);
+	size_t arena_size = (size_t) 1 << 30; // only address space, pages are committed on use
+
+	const char* env = getenv("BUDDY_BLOCK_SIZE");
+	if (env != nullptr && atoi(env) > 0)
+		basic_block_size = atoi(env);
+	env = getenv("BUDDY_ARENA_SIZE");
+	if (env != nullptr && strtoull(env, NULL, 10) > 0)
+		arena_size = strtoull(env, NULL, 10);
+
+	global_allocator = new (allocator_storage) BuddyAllocator(basic_block_size, arena_size, BA_CONCURRENT | BA_NO_HEADER | BA_SLAB | BA_QUIET);
+
+	env = getenv("BUDDY_TRACE");
+	if (env != nullptr && env[0] != '\0')
+		global_allocator->start_trace(env);
+}
+
+static bool too_large(size_t size)
+{ // Sizes no block can hold fail here with ENOMEM, before anything rounds them up
+	return size > MAX_BLOCK_SIZE;
+}
+
+static BuddyAllocator* get_allocator()
+{
+	if (global_allocator == nullptr)
+		pthread_once(&init_once, init_allocator);
+	return global_allocator;
+}
+
+__attribute__((destructor)) static void finish()
+{ /* Prints how the run used the allocator to stderr if BUDDY_REPORT is set (stdout belongs to the program),
+     and writes out the trace since the allocator itself is never destroyed (other threads may still be
+     allocating, so the recorder stays attached).
+  */
+	if (global_allocator == nullptr)
+		return;
+	const char* env = getenv("BUDDY_REPORT");
+	if (env != nullptr && env[0] == '1')
+		global_allocator->usage_report(stderr);
+	global_allocator->flush_trace();
+}
+
+extern "C" {
+
+void* malloc(size_t size)
+{
+	if (too_large(size))
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+
+	void* mem = get_allocator()->alloc(size);
+	if (mem == nullptr)
+		errno = ENOMEM;
+	return mem;
+}
+
+void free(void* ptr)
+{
+	if (ptr != nullptr)
+		get_allocator()->free((char*) ptr);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+	size_t total;
+	if (__builtin_mul_overflow(nmemb, size, &total))
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+
+	void* mem = malloc(total);
+	if (mem != nullptr)
+		memset(mem, 0, total);
+	return mem;
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	if (ptr != nullptr && size == 0)
+	{
+		free(ptr);
+		return nullptr;
+	}
+	if (too_large(size))
+	{ // (the old block stays valid, as with a failed realloc)
+		errno = ENOMEM;
+		return nullptr;
+	}
+
+	void* mem = get_allocator()->realloc((char*) ptr, size);
+	if (mem == nullptr)
+		errno = ENOMEM;
+	return mem;
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+	if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+	if (too_large(size))
+		return ENOMEM;
+
+	void* mem = get_allocator()->alloc_aligned(size, alignment);
+	if (mem == nullptr)
+		return ENOMEM;
+	*memptr = mem;
+	return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+	void* mem = nullptr;
+	int error = posix_memalign(&mem, alignment, size);
+	if (error != 0)
+		errno = error;
+	return mem;
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+	return aligned_alloc(alignment, size);
+}
+
+void* valloc(size_t size)
+{
+	return aligned_alloc(sysconf(_SC_PAGESIZE), size);
+}
+
+void* pvalloc(size_t size)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	if (too_large(size))
+	{ // rounding up to a page would wrap
+		errno = ENOMEM;
+		return nullptr;
+	}
+	return aligned_alloc(page_size, (size + page_size - 1) & ~(page_size - 1));
+}
+
+size_t malloc_usable_size(void* ptr)
+{
+	return (ptr != nullptr) ? get_allocator()->usable_size((char*) ptr) : 0;
+}
+
+}
@@ -4,16 +4,21 @@
 typedef unsigned int uint;
 using namespace std;
 
-uint next_power_of_2(uint n)
+size_t next_power_of_2(size_t n)
 { // Rounds a positive integer up to the next power of two 
 	--n;
-	for (uint i = 1; i <= 16; i *= 2)
+	for (uint i = 1; i <= 32; i *= 2)
 	{
 		n |= n >> i;
 	}
 	return ++n;
 }
 
+uint log2_pow2(size_t n)
+{ // Returns log2 of a power of two using a single count-trailing-zeros instruction
+	return __builtin_ctzll(n);
+}
+
 void swap(BlockHeader*& block1, BlockHeader*& block2)
 { // Swaps two BlockHeaders
 	BlockHeader* temp = block2;
@@ -4,12 +4,16 @@
 
 int main(int argc, char** argv)
 {
-	int basic_block_size = 128, memory_length = 128 * 1024 * 1024;
+	int basic_block_size = 128, threads = 1;
+	int ackerman_n = 0, ackerman_m = 0; // prompt for them unless both are given
+	size_t memory_length = 128 * 1024 * 1024; // arenas are 64-bit sized, so this may exceed 4 GiB
+	int options = BA_DEFAULT;
+	const char* trace_path = NULL; // record every alloc/free here if set
 
 	int opt = 0;
-	while ((opt = getopt(argc, argv, "b:s:")) != -1)
+	while ((opt = getopt(argc, argv, "b:s:t:coln:m:r:")) != -1)
 	{ // While options were received from getopt
-		int n = atoi(optarg);
+		int n = (optarg != NULL) ? atoi(optarg) : 0;
 		switch (opt)
 		{
 			case 'b': // If block size is specified
@@ -21,12 +25,44 @@ int main(int argc, char** argv)
 				basic_block_size = n;
 				break;
 			case 's': // If total size is specified
-				if (n < 1)
+				if (optarg[0] == '-' || strtoull(optarg, NULL, 10) < 1)
 				{
 					printf("ERROR: Memory length must be strictly positive!\n");
 					return 0;
 				}
-				memory_length = n;
+				memory_length = strtoull(optarg, NULL, 10);
+				break;
+			case 't': // If number of threads sharing the allocator is specified
+				if (n < 1)
+				{
+					printf("ERROR: Number of threads must be strictly positive!\n");
+					return 0;
+				}
+				threads = n;
+				break;
+			case 'c': // If small requests should be served from slab size classes
+				options |= BA_SLAB;
+				break;
+			case 'o': // If block metadata should be kept out of band instead of in block headers
+				options |= BA_NO_HEADER;
+				break;
+			case 'l': // If buddies should only be merged once a larger block is needed
+				options |= BA_LAZY;
+				break;
+			case 'n': // If the first Ackerman parameter is specified (runs once, without prompting, together with -m)
+			case 'm': // If the second Ackerman parameter is specified
+				if (n < 1)
+				{
+					printf("ERROR: Ackerman parameters must be strictly positive!\n");
+					return 0;
+				}
+				if (opt == 'n')
+					ackerman_n = n;
+				else
+					ackerman_m = n;
+				break;
+			case 'r': // If the allocations should be recorded to a trace file (replay it with allocbench -i)
+				trace_path = optarg;
 				break;
 			case '?': // If unknown, end the program (getopt produces its own error message)
 				return 0;
@@ -35,14 +71,30 @@ int main(int argc, char** argv)
 
 	cout << "Block size = " << basic_block_size << endl;
 	cout << "Total size = " << memory_length << endl;
-	// create memory manager
-	BuddyAllocator* allocator = new BuddyAllocator(basic_block_size, memory_length);
+	cout << "Threads = " << threads << endl;
+	// create memory manager (shared between threads when more than one is requested)
+	if (threads > 1)
+		options |= BA_CONCURRENT;
+	BuddyAllocator* allocator = new BuddyAllocator(basic_block_size, memory_length, options);
+	if (trace_path != NULL && !allocator->start_trace(trace_path))
+	{
+		printf("ERROR: Could not create trace file %s!\n", trace_path);
+		return 0;
+	}
 
 	// test memory manager
 	Ackerman* am = new Ackerman();
-	am->test(allocator); // this is the full-fledged test.
+	am->test(allocator, threads, ackerman_n, ackerman_m); // this is the full-fledged test.
 	delete am;
 
+	// report how much memory the requests actually consumed, and what the allocator was left with
+	allocator->usage_report();
+	BuddyStats st = allocator->stats();
+	printf("allocations = %llu, frees = %llu, failed = %llu, splits = %llu, merges = %llu\n",
+		st.allocations, st.frees, st.failed_allocations, st.splits, st.merges);
+	printf("in use = %zu, free = %zu, largest free block = %zu bytes, external fragmentation = %.1f%%\n",
+		st.bytes_in_use, st.free_bytes, st.largest_free_block, 100.0 * st.external_fragmentation);
+
 	// destroy memory manager
 	delete allocator;
 }
@@ -0,0 +1,235 @@
+/*
+    File: Trace.cpp
+*/
+#include "Trace.h"
+#include <fcntl.h>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+using namespace std;
+
+static uint64_t monotonic_ns()
+{ // Returns a monotonic timestamp in nanoseconds
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t table_index(uintptr_t address, size_t capacity)
+{ // Hashes an address into a power of two sized table (the low bits of an address carry little entropy)
+	return (size_t) ((address >> 4) * 0x9E3779B97F4A7C15ULL) & (capacity - 1);
+}
+
+static bool write_all(int fd, const char* data, size_t length)
+{ // Writes a whole buffer, retrying short writes
+	while (length > 0)
+	{
+		ssize_t n = write(fd, data, length);
+		if (n <= 0)
+			return false;
+		data += n;
+		length -= n;
+	}
+	return true;
+}
+
+TraceRecorder* TraceRecorder::create(const char* path)
+{ // Opens the trace file and maps the recorder, its record buffer and its address table
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return nullptr;
+
+	TraceFileHeader header = {TRACE_MAGIC, TRACE_VERSION};
+	void* mem = mmap(NULL, sizeof(TraceRecorder), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	void* buffer = mmap(NULL, TRACE_BUFFER_RECORDS * sizeof(TraceRecord), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	void* table = mmap(NULL, TRACE_TABLE_CAPACITY * sizeof(TraceSlot), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED || buffer == MAP_FAILED || table == MAP_FAILED || !write_all(fd, (char*) &header, sizeof(header)))
+	{
+		if (mem != MAP_FAILED)
+			munmap(mem, sizeof(TraceRecorder));
+		if (buffer != MAP_FAILED)
+			munmap(buffer, TRACE_BUFFER_RECORDS * sizeof(TraceRecord));
+		if (table != MAP_FAILED)
+			munmap(table, TRACE_TABLE_CAPACITY * sizeof(TraceSlot));
+		close(fd);
+		return nullptr;
+	}
+
+	TraceRecorder* recorder = new (mem) TraceRecorder();
+	recorder->fd = fd;
+	pthread_mutex_init(&recorder->mtx, NULL);
+	recorder->start_ns = monotonic_ns();
+	recorder->buffer = (TraceRecord*) buffer;
+	recorder->table = (TraceSlot*) table;
+	recorder->table_capacity = TRACE_TABLE_CAPACITY;
+	return recorder;
+}
+
+void TraceRecorder::destroy(TraceRecorder* recorder)
+{ // Flushes and closes the trace, then unmaps everything create() mapped
+	recorder->flush();
+
+	close(recorder->fd);
+	pthread_mutex_destroy(&recorder->mtx);
+	munmap(recorder->buffer, TRACE_BUFFER_RECORDS * sizeof(TraceRecord));
+	munmap(recorder->table, recorder->table_capacity * sizeof(TraceSlot));
+	munmap(recorder, sizeof(TraceRecorder));
+}
+
+void TraceRecorder::record_alloc(char* _a, size_t _length)
+{ // Gives the allocation the next id and remembers it under its address
+	pthread_mutex_lock(&mtx);
+	uint32_t id = next_id++;
+	if (_a != nullptr)
+		insert_id((uintptr_t) _a, id);
+	append(TRACE_ALLOC, id, _length);
+	pthread_mutex_unlock(&mtx);
+}
+
+void TraceRecorder::record_free(char* _a)
+{ // Records a free of a known allocation and forgets its address
+	uint32_t id;
+	pthread_mutex_lock(&mtx);
+	if (take_id((uintptr_t) _a, &id))
+		append(TRACE_FREE, id, 0);
+	pthread_mutex_unlock(&mtx);
+}
+
+void TraceRecorder::flush()
+{
+	pthread_mutex_lock(&mtx);
+	write_buffer();
+	pthread_mutex_unlock(&mtx);
+}
+
+void TraceRecorder::write_buffer()
+{ // Writes out the buffered records (caller holds mtx)
+	if (count > 0 && !write_all(fd, (char*) buffer, count * sizeof(TraceRecord)))
+		fprintf(stderr, "ERROR: Could not write the allocation trace!\n");
+	count = 0;
+}
+
+void TraceRecorder::append(uint8_t op, uint32_t id, uint64_t size)
+{ // Adds a record to the buffer, writing the buffer out when it is full (caller holds mtx)
+	if (count == TRACE_BUFFER_RECORDS)
+		write_buffer();
+
+	TraceRecord* record = &buffer[count++];
+	record->timestamp = monotonic_ns() - start_ns;
+	record->size = size;
+	record->id = id;
+	record->thread = syscall(SYS_gettid);
+	record->op = op;
+}
+
+bool TraceRecorder::insert_id(uintptr_t address, uint32_t id)
+{ // Maps an address to an allocation id, keeping the table at most half full
+	if (2 * (table_used + 1) > table_capacity && !grow_table())
+		return false;
+
+	size_t i = table_index(address, table_capacity);
+	while (table[i].address != 0 && table[i].address != address)
+		i = (i + 1) & (table_capacity - 1);
+	if (table[i].address == 0)
+		++table_used;
+	table[i].address = address;
+	table[i].id = id;
+	return true;
+}
+
+bool TraceRecorder::take_id(uintptr_t address, uint32_t* id)
+{ // Removes an address from the table, returning its id; later entries of the probe run are shifted back into the hole
+	size_t mask = table_capacity - 1;
+	size_t i = table_index(address, table_capacity);
+	while (table[i].address != address)
+	{
+		if (table[i].address == 0)
+			return false;
+		i = (i + 1) & mask;
+	}
+	*id = table[i].id;
+
+	size_t hole = i;
+	for (size_t j = (i + 1) & mask; table[j].address != 0; j = (j + 1) & mask)
+	{ // An entry may fill the hole if its home slot is not cyclically between the hole and itself
+		size_t home = table_index(table[j].address, table_capacity);
+		if (((j - home) & mask) >= ((j - hole) & mask))
+		{
+			table[hole] = table[j];
+			hole = j;
+		}
+	}
+	table[hole].address = 0;
+	--table_used;
+	return true;
+}
+
+bool TraceRecorder::grow_table()
+{ // Doubles the address table and rehashes every live allocation into it
+	size_t capacity = 2 * table_capacity;
+	void* mem = mmap(NULL, capacity * sizeof(TraceSlot), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return false;
+
+	TraceSlot* grown = (TraceSlot*) mem;
+	for (size_t i = 0; i < table_capacity; ++i)
+	{
+		if (table[i].address == 0)
+			continue;
+		size_t j = table_index(table[i].address, capacity);
+		while (grown[j].address != 0)
+			j = (j + 1) & (capacity - 1);
+		grown[j] = table[i];
+	}
+
+	munmap(table, table_capacity * sizeof(TraceSlot));
+	table = grown;
+	table_capacity = capacity;
+	return true;
+}
+
+bool load_trace(const char* path, vector<TraceRecord>& records)
+{ // Reads the header and every record of a trace file
+	FILE* f = fopen(path, "rb");
+	if (f == NULL)
+	{
+		printf("ERROR: Could not open trace %s!\n", path);
+		return false;
+	}
+
+	TraceFileHeader header;
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION)
+	{
+		printf("ERROR: %s is not a version %d allocation trace!\n", path, TRACE_VERSION);
+		fclose(f);
+		return false;
+	}
+
+	TraceRecord record;
+	records.clear();
+	while (fread(&record, sizeof(record), 1, f) == 1)
+		records.push_back(record);
+	fclose(f);
+
+	// Drop records no recorder writes: unknown operations, allocation ids that do not increase (or exceed
+	// the number of records), and frees of ids not allocated yet. Replays can then size tables by id.
+	size_t kept = 0;
+	uint64_t next_id = 0;
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const TraceRecord& r = records[i];
+		if (r.op == TRACE_ALLOC && r.id >= next_id && r.id < records.size())
+			next_id = (uint64_t) r.id + 1;
+		else if (r.op != TRACE_FREE || r.id >= next_id)
+			continue;
+		records[kept++] = r;
+	}
+	if (kept < records.size())
+		printf("WARNING: Skipped %zu corrupt records of trace %s!\n", records.size() - kept, path);
+	records.resize(kept);
+	return true;
+}
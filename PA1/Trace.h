@@ -0,0 +1,97 @@
+/*
+    File: Trace.h
+
+    Binary alloc/free traces. A TraceRecorder attached to a BuddyAllocator
+    (BuddyAllocator::start_trace) appends one TraceRecord per alloc() and
+    free() to a file, and allocbench -i replays such a file against any of its
+    allocator backends. Addresses are not stored: every allocation gets a
+    sequential id, and a free refers to the id of the allocation it releases.
+
+    File layout: a TraceFileHeader followed by packed TraceRecords, in the
+    order the operations took effect, in the byte order of the recording host.
+*/
+
+#ifndef _Trace_h_                   // include file only once
+#define _Trace_h_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+using namespace std;
+
+#define TRACE_MAGIC 0x43525442		// "BTRC"
+#define TRACE_VERSION 1
+#define TRACE_BUFFER_RECORDS 65536	// records buffered in memory between writes
+#define TRACE_TABLE_CAPACITY 65536	// initial number of address -> id slots (doubles as needed)
+
+enum TRACE_RECORD_OP {TRACE_ALLOC = 0, TRACE_FREE = 1};
+
+struct TraceFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct __attribute__((packed)) TraceRecord
+{
+	uint64_t timestamp;	// ns since recording started
+	uint64_t size;		// requested bytes (TRACE_ALLOC only)
+	uint32_t id;		// allocation id, in order of allocation starting at 0
+	uint32_t thread;	// kernel thread id of the caller
+	uint8_t op;			// TRACE_RECORD_OP
+};
+
+struct TraceSlot
+{
+	uintptr_t address;	// 0 marks an empty slot
+	uint32_t id;
+};
+
+class TraceRecorder
+{
+	/* Records operations from any number of threads under one lock. Everything it needs
+	   is mmap'ed, so it can record an allocator that is standing in for malloc. */
+private:
+	int fd = -1;
+	pthread_mutex_t mtx;
+	uint64_t start_ns = 0;
+	uint32_t next_id = 0;
+
+	TraceRecord* buffer = nullptr;
+	uint32_t count = 0;				// records in buffer
+
+	TraceSlot* table = nullptr;		// live allocations, open addressing with linear probing
+	size_t table_capacity = 0;
+	size_t table_used = 0;
+
+	void append(uint8_t op, uint32_t id, uint64_t size);
+	void write_buffer();
+	bool insert_id(uintptr_t address, uint32_t id);
+	bool take_id(uintptr_t address, uint32_t* id);
+	bool grow_table();
+
+public:
+	static TraceRecorder* create(const char* path);
+	/* Opens (truncating) the trace file and returns a new recorder, or nullptr on failure. */
+
+	static void destroy(TraceRecorder* recorder);
+	/* Writes out buffered records, closes the file and unmaps the recorder. */
+
+	void record_alloc(char* _a, size_t _length);
+	/* Records an allocation of _length bytes that returned _a (nullptr for a failed one). */
+
+	void record_free(char* _a);
+	/* Records the release of _a. Must be called before the memory is actually released, so a
+	   concurrent allocation of the same address is recorded after this free. Addresses that
+	   were not recorded as allocated are ignored. */
+
+	void flush();
+	/* Writes buffered records to the file. */
+};
+
+bool load_trace(const char* path, vector<TraceRecord>& records);
+/* Reads a whole trace file. Prints an error and returns false if it is not a valid trace;
+   records that cannot come from a recorder are skipped with a warning. */
+
+#endif
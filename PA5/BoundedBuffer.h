@@ -5,10 +5,12 @@
 #include <queue>
 #include <string>
 #include <pthread.h>
+#include <string.h>
+#include "RequestBuffer.h"
 
 using namespace std;
 
-class BoundedBuffer
+class BoundedBuffer : public RequestBuffer
 {
 private:
   	int cap;
@@ -52,9 +54,60 @@ public:
 		size++;
 
 		pthread_cond_signal(&cond1);
+		if (size < cap) // pass on a wakeup a batch may have left for several producers
+			pthread_cond_signal(&cond2);
 		pthread_mutex_unlock(&mtx);
 	}
 
+	void push_many(char* data, int len, int count){
+		pthread_mutex_lock(&mtx);
+		while (count > 0)
+		{
+			while(size == cap)
+			{
+				pthread_cond_wait(&cond2, &mtx);
+			}
+
+			for (; count > 0 && size < cap; count--, data += len)
+			{ // move everything that fits before waking anyone
+				q.push(vector<char>(data, data + len));
+				size++;
+			}
+			pthread_cond_signal(&cond1);
+		}
+		if (size < cap)
+			pthread_cond_signal(&cond2);
+		pthread_mutex_unlock(&mtx);
+	}
+
+	int pop_many(char* data, int* lens, int k){
+		pthread_mutex_lock(&mtx);
+		
+		while(size == 0)
+		{
+			pthread_cond_wait(&cond1, &mtx);
+		}
+
+		int n = 0;
+		while (n < k && size > 0)
+		{
+			vector<char>& msg = q.front();
+			lens[n] = msg.size();
+			if (lens[n] > 0)
+				memcpy(data + n * MAX_MESSAGE, msg.data(), lens[n]);
+			q.pop();
+			size--;
+			if (lens[n++] == 0) // a quit message ends the batch
+				break;
+		}
+		
+		pthread_cond_signal(&cond2);
+		if (size > 0) // leave the rest of the backlog to another consumer
+			pthread_cond_signal(&cond1);
+		pthread_mutex_unlock(&mtx);
+		return n;
+	}
+
 	vector<char> pop(){
 		pthread_mutex_lock(&mtx);
 		
@@ -68,6 +121,8 @@ public:
 		size--;
 		
 		pthread_cond_signal(&cond2);
+		if (size > 0)
+			pthread_cond_signal(&cond1);
 		pthread_mutex_unlock(&mtx);
 		return result;
 	}
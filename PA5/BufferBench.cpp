@@ -0,0 +1,172 @@
+/*
+    File: BufferBench.cpp
+
+    Request buffer benchmark. Runs the client's traffic pattern (datamsg sized
+    messages) through each request buffer with 1, 2, 4, ... producer/consumer
+    pairs, and reports throughput and heap allocations per message:
+
+        mutex       BoundedBuffer, push/pop
+        slot        SlotBuffer, messages written and read in place (reserve/acquire)
+        lock-free   LockFreeBuffer, in place
+
+        bufferbench [-n total messages] [-b capacity] [-t max pairs]
+*/
+
+#include "common.h"
+#include "BoundedBuffer.h"
+#include "SlotBuffer.h"
+#include "LockFreeBuffer.h"
+#include <new>
+
+static unsigned long long allocations = 0; // operator new calls, all threads
+
+__attribute__((noinline)) void* operator new(size_t size)
+{ // counts every heap allocation made through new (out of line, so GCC does not pair an inlined malloc with delete)
+	__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+	void* p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw bad_alloc();
+	return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+struct bench_thread_args
+{
+	RequestBuffer* buffer;
+	bool in_place; // reserve/commit and acquire/release instead of push/pop
+	int n; // messages this thread pushes or pops
+};
+
+void* producer_thread_function(void* arg)
+{ // sends n datamsgs
+	struct bench_thread_args* arguments = (struct bench_thread_args*) arg;
+	datamsg msg(1, 0, 1);
+	BufferSlot slot;
+	for (int i = 0; i < arguments->n; i++)
+	{
+		msg.seconds = i;
+		if (arguments->in_place)
+		{
+			arguments->buffer->reserve(slot);
+			*(datamsg*) slot.data = msg;
+			slot.len = sizeof(datamsg);
+			arguments->buffer->commit(slot);
+		}
+		else
+		{
+			arguments->buffer->push((char*) &msg, sizeof(datamsg));
+		}
+	}
+	return NULL;
+}
+
+void* consumer_thread_function(void* arg)
+{ // receives n messages
+	struct bench_thread_args* arguments = (struct bench_thread_args*) arg;
+	BufferSlot slot;
+	for (int i = 0; i < arguments->n; i++)
+	{
+		int len;
+		if (arguments->in_place)
+		{
+			arguments->buffer->acquire(slot);
+			len = slot.len;
+			arguments->buffer->release(slot);
+		}
+		else
+		{
+			len = arguments->buffer->pop().size();
+		}
+		if (len != sizeof(datamsg))
+		{
+			EXITONERROR("consumer received a truncated message");
+		}
+	}
+	return NULL;
+}
+
+void run(const char* name, RequestBuffer* buffer, bool in_place, int pairs, int n)
+{ // moves pairs * n messages through the buffer with pairs producers and pairs consumers and prints the rates
+	pthread_t producers[pairs], consumers[pairs];
+	struct bench_thread_args args;
+	args.buffer = buffer;
+	args.in_place = in_place;
+	args.n = n;
+
+	struct timeval start, end;
+	unsigned long long allocations_before = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+	gettimeofday(&start, 0);
+	for (int i = 0; i < pairs; i++)
+	{
+		pthread_create(&consumers[i], NULL, consumer_thread_function, (void*) &args);
+		pthread_create(&producers[i], NULL, producer_thread_function, (void*) &args);
+	}
+	for (int i = 0; i < pairs; i++)
+	{
+		pthread_join(producers[i], NULL);
+		pthread_join(consumers[i], NULL);
+	}
+	gettimeofday(&end, 0);
+
+	double secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+	double messages = (double) pairs * n;
+	double allocs = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - allocations_before;
+	printf("%6d %10s %14.0f %12.2f\n", pairs, name, messages / secs, allocs / messages);
+}
+
+int main(int argc, char* argv[])
+{
+	int n = 200000;	// messages per run, split evenly across the producers
+	int b = 100;	// buffer capacity
+	int t = 16;		// largest number of producer/consumer pairs
+
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "n:b:t:")) != -1)
+	{ // while options were received from getopt
+		int arg = atoi(optarg);
+		switch (opt)
+		{
+			case 'n':
+				if (arg < 1)
+				{
+					printf("ERROR: Number of messages must be strictly positive!\n");
+					exit(EXIT_FAILURE);
+				}
+				n = arg;
+				break;
+			case 'b':
+				if (arg < 1 || arg > 1000)
+				{
+					printf("ERROR: Buffer size out of acceptable range! [1-1000]\n");
+					exit(EXIT_FAILURE);
+				}
+				b = arg;
+				break;
+			case 't':
+				if (arg < 1 || arg > 1000)
+				{
+					printf("ERROR: Number of thread pairs out of acceptable range! [1-1000]\n");
+					exit(EXIT_FAILURE);
+				}
+				t = arg;
+				break;
+			case '?': // if unknown, end the program (getopt produces its own error message)
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	printf("%6s %10s %14s %12s\n", "pairs", "buffer", "msgs/sec", "allocs/msg");
+	for (int pairs = 1; pairs <= t; pairs *= 2)
+	{
+		BoundedBuffer mutex_buffer(b);
+		SlotBuffer slot_buffer(b);
+		LockFreeBuffer lock_free_buffer(b);
+		run("mutex", &mutex_buffer, false, pairs, n / pairs);
+		run("slot", &slot_buffer, true, pairs, n / pairs);
+		run("lock-free", &lock_free_buffer, true, pairs, n / pairs);
+	}
+}
@@ -0,0 +1,197 @@
+/*
+    File: ChannelBench.cpp
+
+    Request channel benchmark. Opens c channels between this process (the client
+    side) and a forked echo process (the server side) and reports:
+
+        setup       both ends of all c channels created and usable
+        latency     round trip of a datamsg and its double reply, over every channel in turn
+        bulk        one s byte cwrite_bulk per channel, acknowledged (on SHM the first
+                    bulk transfer also creates the channel's bulk regions)
+        teardown    deleting the client ends, which removes the IPC objects
+
+        channelbench [-c channels] [-r rounds] [-s bulk bytes] [-i f|q|s]
+*/
+
+#include "common.h"
+#include "FIFORequestChannel.h"
+#include "MQRequestChannel.h"
+#include "SHMRequestChannel.h"
+#include <sys/wait.h>
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+RequestChannel* open_channel(CHANNEL_TYPE chan_type, string name, RequestChannel::Side side)
+{
+	switch (chan_type)
+	{
+		case FIFO:
+			return new FIFORequestChannel(name, side);
+		case MESSAGE_QUEUE:
+			return new MQRequestChannel(name, side);
+		default:
+			return new SHMRequestChannel(name, side);
+	}
+}
+
+void echo_process(CHANNEL_TYPE chan_type, int c, int r, int s)
+{ // the server side: answers the parent's traffic in the same channel order, then exits without deleting its ends, like the dataserver
+	vector<RequestChannel*> channels(c);
+	char ready = 1;
+	for (int i = 0; i < c; i++)
+	{
+		channels[i] = open_channel(chan_type, "bench_" + to_string(i), RequestChannel::SERVER_SIDE);
+	}
+	for (int i = 0; i < c; i++)
+	{
+		channels[i]->cwrite(&ready, sizeof(ready));
+	}
+
+	double reply = 0;
+	for (int round = 0; round < r; round++)
+	{
+		for (int i = 0; i < c; i++)
+		{
+			int len = 0;
+			char* request = channels[i]->cacquire(&len);
+			reply = ((datamsg*) request)->seconds;
+			channels[i]->crelease(request);
+			channels[i]->cwrite((char*) &reply, sizeof(reply));
+		}
+	}
+
+	char* buf = new char[s];
+	for (int i = 0; i < c; i++)
+	{
+		channels[i]->cread_bulk(buf, s);
+		channels[i]->cwrite(&ready, sizeof(ready));
+	}
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char* argv[])
+{
+	int c = 1000;				// channels
+	int r = 10;					// round trips per channel
+	int s = 64 * 1024;			// bulk payload per channel
+	CHANNEL_TYPE chan_type = SHARED_MEMORY;
+
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "c:r:s:i:")) != -1)
+	{ // while options were received from getopt
+		int arg = atoi(optarg);
+		switch (opt)
+		{
+			case 'c':
+				if (arg < 1 || arg > 10000)
+				{
+					printf("ERROR: Number of channels out of acceptable range! [1-10000]\n");
+					exit(EXIT_FAILURE);
+				}
+				c = arg;
+				break;
+			case 'r':
+				if (arg < 1)
+				{
+					printf("ERROR: Number of rounds must be strictly positive!\n");
+					exit(EXIT_FAILURE);
+				}
+				r = arg;
+				break;
+			case 's':
+				if (arg < 1 || arg > MAX_BULK_CHUNK)
+				{
+					printf("ERROR: Bulk payload out of acceptable range! [1-%d]\n", MAX_BULK_CHUNK);
+					exit(EXIT_FAILURE);
+				}
+				s = arg;
+				break;
+			case 'i':
+				switch (tolower(optarg[0]))
+				{
+					case 'f':
+						chan_type = FIFO;
+						break;
+					case 'q':
+						chan_type = MESSAGE_QUEUE;
+						break;
+					case 's':
+						chan_type = SHARED_MEMORY;
+						break;
+					default:
+						printf("ERROR: Unknown channel type! [f, q, s]\n");
+						exit(EXIT_FAILURE);
+				}
+				break;
+			case '?': // if unknown, end the program (getopt produces its own error message)
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	double start = now();
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		echo_process(chan_type, c, r, s);
+	}
+	vector<RequestChannel*> channels(c);
+	for (int i = 0; i < c; i++)
+	{
+		channels[i] = open_channel(chan_type, "bench_" + to_string(i), RequestChannel::CLIENT_SIDE);
+	}
+	for (int i = 0; i < c; i++)
+	{ // wait until the server side has every channel open
+		int len = 0;
+		channels[i]->crelease(channels[i]->cacquire(&len));
+	}
+	double setup = now() - start;
+
+	datamsg msg(1, 0, 1);
+	start = now();
+	for (int round = 0; round < r; round++)
+	{
+		for (int i = 0; i < c; i++)
+		{
+			msg.seconds = i;
+			channels[i]->cwrite((char*) &msg, sizeof(datamsg));
+			int len = 0;
+			char* reply = channels[i]->cacquire(&len);
+			if (len != sizeof(double) || *(double*) reply != i)
+			{
+				printf("ERROR: Channel %d returned a wrong reply!\n", i);
+				exit(EXIT_FAILURE);
+			}
+			channels[i]->crelease(reply);
+		}
+	}
+	double latency = now() - start;
+
+	char* buf = new char[s];
+	memset(buf, 1, s);
+	start = now();
+	for (int i = 0; i < c; i++)
+	{
+		channels[i]->cwrite_bulk(buf, s);
+		int len = 0;
+		channels[i]->crelease(channels[i]->cacquire(&len));
+	}
+	double bulk = now() - start;
+	waitpid(pid, NULL, 0);
+
+	start = now();
+	for (int i = 0; i < c; i++)
+	{
+		delete channels[i];
+	}
+	double teardown = now() - start;
+
+	printf("%10s %12s %14s\n", "phase", "total ms", "per channel us");
+	printf("%10s %12.1f %14.1f\n", "setup", setup * 1e3, setup * 1e6 / c);
+	printf("%10s %12.1f %14.1f   (%.1f us per round trip)\n", "latency", latency * 1e3, latency * 1e6 / c, latency * 1e6 / c / r);
+	printf("%10s %12.1f %14.1f\n", "bulk", bulk * 1e3, bulk * 1e6 / c);
+	printf("%10s %12.1f %14.1f\n", "teardown", teardown * 1e3, teardown * 1e6 / c);
+}
@@ -0,0 +1,151 @@
+/*
+    File: ECGBench.cpp
+
+    Dataserver ECG store benchmark. Loads the BIMDC files the way the server used
+    to (one std::string per csv line, split and stod on every lookup), parses them
+    into the columnar ecg_data store, and maps the binary cache written by
+    ecgconvert if there is one. Reports the startup time of each and the average
+    latency of random data point lookups.
+
+        ecgbench [-n lookups] [-d BIMDC directory]
+*/
+
+#include "common.h"
+#include "ECGData.h"
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the original store: csv lines kept as strings and parsed on every request
+vector<string> line_data [NUM_PERSONS];
+
+void populate_lines (string filename, vector<string>& lines){
+	char line[100];
+	ifstream ifs (filename.c_str());
+	while (!ifs.eof()){
+		line[0] = 0;
+		ifs.getline(line, 100);
+		if (ifs.eof())
+			break;
+		if (line [0])
+			lines.push_back(string(line));
+	}
+}
+
+double get_line_data (int person, double seconds, int ecgno){
+	int index = (int)round (seconds / 0.004);
+	string line = line_data [person-1][index]; 
+	vector<string> parts = split (line, ',');
+	double ecg1 = stod (parts [1]);
+	double ecg2 = stod (parts [2]); 
+	if (ecgno == 1)
+		return ecg1;
+	else
+		return ecg2;
+}
+
+ecg_data column_data [NUM_PERSONS];
+
+int main(int argc, char* argv[])
+{
+	int n = 1000000;		// lookups per store
+	string dir = "BIMDC";
+
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "n:d:")) != -1)
+	{ // while options were received from getopt
+		switch (opt)
+		{
+			case 'n':
+				n = atoi(optarg);
+				if (n < 1)
+				{
+					printf("ERROR: Number of lookups must be strictly positive!\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'd':
+				dir = optarg;
+				break;
+			case '?': // if unknown, end the program (getopt produces its own error message)
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	double start = now();
+	for (int i = 0; i < NUM_PERSONS; i++)
+	{
+		populate_lines(dir + "/" + to_string(i + 1) + ".csv", line_data[i]);
+	}
+	double line_startup = now() - start;
+
+	start = now();
+	for (int i = 0; i < NUM_PERSONS; i++)
+	{
+		if (!load_ecg_data(dir + "/" + to_string(i + 1) + ".csv", column_data[i]))
+		{
+			printf("ERROR: Could not read %s/%d.csv!\n", dir.c_str(), i + 1);
+			exit(EXIT_FAILURE);
+		}
+	}
+	double column_startup = now() - start;
+
+	ecg_data mapped_data [NUM_PERSONS];
+	start = now();
+	bool mapped = map_ecg_cache(dir + "/" + ECG_CACHE_FILE, mapped_data);
+	double mapped_startup = now() - start;
+
+	// the same random (person, sample, ecgno) sequence for both stores
+	vector<int> persons(n), samples(n), ecgnos(n);
+	srand(1);
+	for (int i = 0; i < n; i++)
+	{
+		persons[i] = 1 + rand() % NUM_PERSONS;
+		samples[i] = rand() % column_data[persons[i] - 1].count;
+		ecgnos[i] = 1 + rand() % 2;
+	}
+
+	double line_sum = 0, column_sum = 0; // compared below, and keeps the lookups from being optimized away
+	start = now();
+	for (int i = 0; i < n; i++)
+	{
+		line_sum += get_line_data(persons[i], samples[i] * ECG_INTERVAL, ecgnos[i]);
+	}
+	double line_lookup = now() - start;
+
+	start = now();
+	for (int i = 0; i < n; i++)
+	{
+		column_sum += ecg_value(column_data[persons[i] - 1], ecg_index(samples[i] * ECG_INTERVAL), ecgnos[i]);
+	}
+	double column_lookup = now() - start;
+
+	double mapped_sum = column_sum, mapped_lookup = 0;
+	if (mapped)
+	{
+		mapped_sum = 0;
+		start = now();
+		for (int i = 0; i < n; i++)
+		{
+			mapped_sum += ecg_value(mapped_data[persons[i] - 1], ecg_index(samples[i] * ECG_INTERVAL), ecgnos[i]);
+		}
+		mapped_lookup = now() - start;
+	}
+
+	if (line_sum != column_sum || mapped_sum != column_sum)
+	{
+		printf("ERROR: The stores returned different data!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("%10s %12s %14s\n", "store", "startup ms", "lookup ns");
+	printf("%10s %12.1f %14.1f\n", "lines", line_startup * 1e3, line_lookup * 1e9 / n);
+	printf("%10s %12.1f %14.1f\n", "columns", column_startup * 1e3, column_lookup * 1e9 / n);
+	if (mapped)
+		printf("%10s %12.1f %14.1f\n", "mapped", mapped_startup * 1e3, mapped_lookup * 1e9 / n);
+	else
+		printf("%10s (no %s/%s, run ecgconvert)\n", "mapped", dir.c_str(), ECG_CACHE_FILE);
+}
@@ -0,0 +1,52 @@
+/*
+    File: ECGConvert.cpp
+
+    Converts BIMDC/1.csv ... BIMDC/15.csv into the binary columnar cache
+    BIMDC/ecg.bin, which the dataserver maps at startup instead of parsing the
+    csv files. Rerun it whenever the csv files change; the dataserver ignores a
+    cache older than any of them.
+
+        ecgconvert [-d BIMDC directory]
+*/
+
+#include "common.h"
+#include "ECGData.h"
+
+int main(int argc, char* argv[])
+{
+	string dir = "BIMDC";
+
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "d:")) != -1)
+	{ // while options were received from getopt
+		switch (opt)
+		{
+			case 'd':
+				dir = optarg;
+				break;
+			case '?': // if unknown, end the program (getopt produces its own error message)
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	ecg_data data [NUM_PERSONS];
+	uint64_t samples = 0;
+	for (int i = 0; i < NUM_PERSONS; i++)
+	{
+		string filename = dir + "/" + to_string(i + 1) + ".csv";
+		if (!load_ecg_data(filename, data[i]))
+		{
+			printf("ERROR: Could not read %s!\n", filename.c_str());
+			exit(EXIT_FAILURE);
+		}
+		samples += data[i].count;
+	}
+
+	string cache = dir + "/" + ECG_CACHE_FILE;
+	if (!write_ecg_cache(cache, data))
+	{
+		printf("ERROR: Could not write %s!\n", cache.c_str());
+		exit(EXIT_FAILURE);
+	}
+	printf("Wrote %llu samples of %d persons to %s\n", (unsigned long long) samples, NUM_PERSONS, cache.c_str());
+}
@@ -0,0 +1,124 @@
+#include "ECGData.h"
+#include <sys/mman.h>
+using namespace std;
+
+bool load_ecg_data (string filename, ecg_data& data){
+	FILE* fp = fopen (filename.c_str(), "rb");
+	if (!fp)
+		return false;
+
+	// read the whole file at once, then parse it in place
+	fseek (fp, 0, SEEK_END);
+	long size = ftell (fp);
+	fseek (fp, 0, SEEK_SET);
+	char* text = new char [size + 1];
+	size = fread (text, 1, size, fp);
+	text [size] = 0;
+	fclose (fp);
+
+	vector<double> seconds, ecg1, ecg2;
+	char* p = text;
+	while (*p){
+		char* end;
+		double sec = strtod (p, &end);
+		if (end == p){ // blank or unparsable line
+			p = strchr (p, '\n');
+			if (!p)
+				break;
+			p++;
+			continue;
+		}
+		p = end + (*end == ',');
+		double e1 = strtod (p, &end);
+		p = end + (*end == ',');
+		double e2 = strtod (p, &end);
+		p = end;
+		while (*p && *p != '\n')
+			p++;
+		if (*p)
+			p++;
+
+		seconds.push_back (sec);
+		ecg1.push_back (e1);
+		ecg2.push_back (e2);
+	}
+	delete[] text;
+
+	// keep the three columns back to back in one allocation
+	data.count = seconds.size();
+	data.storage = seconds;
+	data.storage.insert (data.storage.end(), ecg1.begin(), ecg1.end());
+	data.storage.insert (data.storage.end(), ecg2.begin(), ecg2.end());
+	data.seconds = data.storage.data();
+	data.ecg1 = data.seconds + data.count;
+	data.ecg2 = data.ecg1 + data.count;
+	return true;
+}
+
+bool write_ecg_cache (string filename, ecg_data data [NUM_PERSONS]){
+	ecg_cache_header header;
+	memset (&header, 0, sizeof (header));
+	header.magic = ECG_CACHE_MAGIC;
+	header.version = ECG_CACHE_VERSION;
+	header.persons = NUM_PERSONS;
+	uint64_t offset = sizeof (header);
+	for (int i = 0; i < NUM_PERSONS; i++){
+		header.count [i] = data [i].count;
+		header.offset [i] = offset;
+		offset += 3 * data [i].count * sizeof (double);
+	}
+
+	// running servers map the old file, so the new one is written beside it and renamed over it
+	// (truncating it in place would pull the pages out from under them)
+	string temp = filename + ".tmp." + to_string (getpid());
+	FILE* fp = fopen (temp.c_str(), "wb");
+	if (!fp)
+		return false;
+	bool ok = fwrite (&header, sizeof (header), 1, fp) == 1;
+	for (int i = 0; ok && i < NUM_PERSONS; i++){
+		size_t n = data [i].count;
+		ok = fwrite (data [i].seconds, sizeof (double), n, fp) == n
+			&& fwrite (data [i].ecg1, sizeof (double), n, fp) == n
+			&& fwrite (data [i].ecg2, sizeof (double), n, fp) == n;
+	}
+	ok = (fclose (fp) == 0) && ok && rename (temp.c_str(), filename.c_str()) == 0;
+	if (!ok)
+		unlink (temp.c_str());
+	return ok;
+}
+
+bool map_ecg_cache (string filename, ecg_data data [NUM_PERSONS]){
+	int fd = open (filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat (fd, &st) < 0 || st.st_size < (off_t) sizeof (ecg_cache_header)){
+		close (fd);
+		return false;
+	}
+	void* mem = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (mem == MAP_FAILED)
+		return false;
+
+	ecg_cache_header* header = (ecg_cache_header*) mem;
+	bool valid = header->magic == ECG_CACHE_MAGIC && header->version == ECG_CACHE_VERSION && header->persons == NUM_PERSONS;
+	for (int i = 0; valid && i < NUM_PERSONS; i++){
+		valid = header->offset [i] % sizeof (double) == 0
+			&& header->offset [i] + 3 * header->count [i] * sizeof (double) <= (uint64_t) st.st_size;
+	}
+	if (!valid){
+		munmap (mem, st.st_size);
+		return false;
+	}
+
+	for (int i = 0; i < NUM_PERSONS; i++){
+		const double* columns = (const double*) ((char*) mem + header->offset [i]);
+		data [i].count = header->count [i];
+		data [i].seconds = columns;
+		data [i].ecg1 = columns + header->count [i];
+		data [i].ecg2 = columns + 2 * header->count [i];
+		data [i].storage.clear();
+	}
+	return true;
+}
@@ -0,0 +1,54 @@
+#ifndef ECGData_h
+#define ECGData_h
+
+#include "common.h"
+
+#define ECG_INTERVAL 0.004 // seconds between consecutive samples of a BIMDC file
+#define ECG_CACHE_FILE "ecg.bin" // binary cache written by ecgconvert next to the csv files
+#define ECG_CACHE_MAGIC 0x42474345 // "ECGB"
+#define ECG_CACHE_VERSION 1
+
+struct ecg_data
+{ // one person's BIMDC samples as columns; sample i was taken at seconds[i]
+	int count = 0;
+	const double* seconds = nullptr;
+	const double* ecg1 = nullptr;
+	const double* ecg2 = nullptr;
+	vector<double> storage; // backs the columns of data parsed from csv (mapped data lives in the cache file)
+};
+
+/* Cache file layout: an ecg_cache_header, then for every person its seconds, ecg1 and ecg2
+   columns of count[person] doubles each, starting at offset[person] bytes into the file.
+   Columns are stored in the byte order of the host that wrote them. */
+struct ecg_cache_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t persons;
+	uint32_t reserved;
+	uint64_t count [NUM_PERSONS];
+	uint64_t offset [NUM_PERSONS];
+};
+
+bool load_ecg_data (string filename, ecg_data& data);
+/* Parses a BIMDC csv file ("seconds,ecg1,ecg2" per line) into data. Returns false if the
+   file cannot be read. */
+
+bool write_ecg_cache (string filename, ecg_data data [NUM_PERSONS]);
+/* Writes the samples of all persons to a binary cache file. The file is replaced with rename(),
+   so servers that still map the old one keep reading it. Returns false on failure. */
+
+bool map_ecg_cache (string filename, ecg_data data [NUM_PERSONS]);
+/* Maps a cache file read-only and points every person's columns into it; nothing is parsed or
+   copied, and processes mapping the same file share its pages. Returns false (leaving data
+   untouched) if the file is missing or is not a valid cache. The mapping is never unmapped. */
+
+inline int ecg_index (double seconds){
+	return (int) round (seconds / ECG_INTERVAL);
+}
+
+inline double ecg_value (const ecg_data& data, int index, int ecgno){
+	return (ecgno == 1) ? data.ecg1 [index] : data.ecg2 [index];
+}
+
+#endif /* ECGData_h */
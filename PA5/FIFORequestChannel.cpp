@@ -8,6 +8,8 @@ using namespace std;
 
 FIFORequestChannel::FIFORequestChannel(const string _name, const Side _side) : RequestChannel(_name, _side)
 {
+	rstart = rend = 0;
+	bulk_pipe = false;
 	pipe1 = "fifo_" + my_name + "1";
 	pipe2 = "fifo_" + my_name + "2";
 		
@@ -42,11 +44,34 @@ int FIFORequestChannel::open_pipe(string _pipe_name, int mode)
 	return fd;
 }
 
+bool FIFORequestChannel::fill(int n)
+{ // reads until at least n unconsumed bytes are buffered; false if the other side closed the pipe
+	if (rstart + n > FIFO_READ_BUFFER){ // make room behind the buffered bytes
+		memmove(rbuf, rbuf + rstart, rend - rstart);
+		rend -= rstart;
+		rstart = 0;
+	}
+	while (rend - rstart < n){
+		int nbytes = read(rfd, rbuf + rend, FIFO_READ_BUFFER - rend);
+		if (nbytes <= 0)
+			return false;
+		rend += nbytes;
+	}
+	return true;
+}
+
 char* FIFORequestChannel::cread(int *len)
 {
 	char * buf = new char [MAX_MESSAGE];
-	int length; 
-	length = read(rfd, buf, MAX_MESSAGE);
+	int length = 0;
+	if (fill(sizeof(int))){
+		memcpy(&length, rbuf + rstart, sizeof(int));
+		if (length < 0 || length > MAX_MESSAGE || !fill(sizeof(int) + length)){
+			EXITONERROR("cread");
+		}
+		memcpy(buf, rbuf + rstart + sizeof(int), length);
+		rstart += sizeof(int) + length;
+	}
 	if (len)	// the caller wants to know the length
 		*len = length;
 	return buf;
@@ -57,9 +82,79 @@ int FIFORequestChannel::cwrite(char* msg, int len)
 	if (len > MAX_MESSAGE){
 		EXITONERROR("cwrite");
 	}
-	if (write(wfd, msg, len) < 0){
+	char frame[sizeof(int) + MAX_MESSAGE]; // one write of at most PIPE_BUF bytes, so frames never interleave
+	memcpy(frame, &len, sizeof(int));
+	memcpy(frame + sizeof(int), msg, len);
+	if (write(wfd, frame, sizeof(int) + len) < 0){
 		EXITONERROR("cwrite");
 	}
 	return len;
 }
 
+void FIFORequestChannel::enlarge_pipe()
+{ // fewer, larger pipe transfers; the default capacity is kept if this fails
+	if (!bulk_pipe){
+		fcntl(wfd, F_SETPIPE_SZ, FIFO_BULK_PIPE);
+		bulk_pipe = true;
+	}
+}
+
+int FIFORequestChannel::cwrite_bulk(char* data, int len)
+{
+	enlarge_pipe();
+	for (int sent = 0; sent < len; ){
+		int nbytes = write(wfd, data + sent, len - sent);
+		if (nbytes < 0){
+			EXITONERROR("cwrite_bulk");
+		}
+		sent += nbytes;
+	}
+	return len;
+}
+
+int FIFORequestChannel::cread_bulk(char* buf, int len)
+{
+	int received = min(rend - rstart, len); // bytes that arrived together with an earlier frame
+	memcpy(buf, rbuf + rstart, received);
+	rstart += received;
+	while (received < len){
+		int nbytes = read(rfd, buf + received, len - received);
+		if (nbytes <= 0){
+			EXITONERROR("cread_bulk");
+		}
+		received += nbytes;
+	}
+	return len;
+}
+
+int FIFORequestChannel::cwrite_file(int fd, __int64_t offset, int len)
+{
+	enlarge_pipe();
+	loff_t off = offset;
+	for (int sent = 0; sent < len; ){
+		ssize_t nbytes = splice(fd, &off, wfd, NULL, len - sent, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (nbytes <= 0){
+			EXITONERROR("cwrite_file");
+		}
+		sent += nbytes;
+	}
+	return len;
+}
+
+int FIFORequestChannel::cread_file(int fd, __int64_t offset, int len)
+{
+	int received = min(rend - rstart, len); // bytes that arrived together with an earlier frame
+	if (received > 0 && pwrite(fd, rbuf + rstart, received, offset) != received){
+		EXITONERROR("cread_file");
+	}
+	rstart += received;
+	loff_t off = offset + received;
+	while (received < len){
+		ssize_t nbytes = splice(rfd, NULL, fd, &off, len - received, SPLICE_F_MOVE);
+		if (nbytes <= 0){
+			EXITONERROR("cread_file");
+		}
+		received += nbytes;
+	}
+	return len;
+}
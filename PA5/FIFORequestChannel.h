@@ -4,16 +4,29 @@
 
 #include "RequestChannel.h"
 
+#define FIFO_READ_BUFFER 4096 // at least one frame: sizeof(int) + MAX_MESSAGE
+#define FIFO_BULK_PIPE (1 << 20) // pipe capacity requested for bulk transfers (capped by /proc/sys/fs/pipe-max-size)
+
 class FIFORequestChannel : public RequestChannel
 {	
 private:
-	/* The current implementation uses named pipes. */
+	/* The current implementation uses named pipes. A pipe is a byte stream, so every message
+	   is framed with its length; reads pull in as many frames as are waiting at once and
+	   cread hands them out one at a time. This keeps message boundaries when several
+	   messages are in flight (pipelined requests). Bulk payloads are not framed: they are
+	   streamed straight through the pipe and the reader knows their length. */
 	
 	int wfd;
 	int rfd;
 	
+	char rbuf[FIFO_READ_BUFFER]; // frames read from rfd but not yet returned by cread
+	int rstart, rend;
+	bool bulk_pipe; // wfd was already enlarged for bulk writes
+	void enlarge_pipe();
+	
 	string pipe1, pipe2;
 	int open_pipe(string _pipe_name, int mode);
+	bool fill(int n);
 	
 public:
 	FIFORequestChannel(const string _name, const Side _side);
@@ -37,12 +50,25 @@ public:
 	 mechanisms associated with the channel. */
 
 	char* cread(int *len=NULL);
-	/* Blocking read of data from the channel. Returns a string of characters
-	 read from the channel. Returns NULL if read failed. */
+	/* Blocking read of one message from the channel. Returns a string of characters
+	 read from the channel. If the other side closed the channel, *len is set to 0. */
 
 	int cwrite(char *msg, int msglen);
 	/* Write the data to the channel. The function returns the number of characters written
 	 to the channel. */
+
+	int cwrite_bulk(char *data, int len);
+	/* Streams len bytes through the pipe (enlarged to FIFO_BULK_PIPE on first use). */
+
+	int cread_bulk(char *buf, int len);
+	/* Reads exactly len streamed bytes straight into buf. */
+
+	int cwrite_file(int fd, __int64_t offset, int len);
+	/* Splices len bytes of file fd from the page cache into the pipe, without copying them
+	 through user space. */
+
+	int cread_file(int fd, __int64_t offset, int len);
+	/* Splices len streamed bytes from the pipe into file fd at offset. */
 	 
 	string name(); 
 };
@@ -1,29 +1,41 @@
 #include "KernelSemaphore.h"
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
-KernelSemaphore::KernelSemaphore(string _name, int _val)
+KernelSemaphore::KernelSemaphore(semaphore_state* _state, int _val)
 {
-	value = new int();
-
-	name = "/" + _name;
-	sem = sem_open(name.c_str(), O_CREAT, 0666, _val);
-	if (sem < 0)
-	{
-		EXITONERROR(name);
-	}
+	state = _state;
+	initial = _val;
 } 
 
 KernelSemaphore::~KernelSemaphore()
 {
-	sem_unlink(name.c_str());
-	sem_close(sem);
+	// the state belongs to the segment, which its owner unmaps
 }
 
 void KernelSemaphore::P()
 {
-	sem_wait(sem);
+	for (;;)
+	{
+		int count = __atomic_load_n(&state->count, __ATOMIC_SEQ_CST);
+		if (initial + count > 0)
+		{
+			if (__atomic_compare_exchange_n(&state->count, &count, count - 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+				return;
+			continue;
+		}
+
+		// announce the sleep before checking once more, so a V() in between either sees it or changed the count
+		__atomic_fetch_add(&state->waiters, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&state->count, __ATOMIC_SEQ_CST) == count)
+			syscall(SYS_futex, &state->count, FUTEX_WAIT, count, NULL, NULL, 0);
+		__atomic_fetch_sub(&state->waiters, 1, __ATOMIC_SEQ_CST);
+	}
 }
 
 void KernelSemaphore::V()
 {
-	sem_post(sem);
-}
\ No newline at end of file
+	__atomic_fetch_add(&state->count, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&state->waiters, __ATOMIC_SEQ_CST) > 0)
+		syscall(SYS_futex, &state->count, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
@@ -1,21 +1,32 @@
 #ifndef _KernelSemaphore_H_
 #define _KernelSemaphore_H_
 
-#include <semaphore.h>
 #include "common.h"
 using namespace std;
 
+struct semaphore_state
+{ // the part of a KernelSemaphore that lives in shared memory; all zeros is the initial value
+	int count;				// V()s minus P()s so far; doubles as the futex word
+	unsigned int waiters;	// processes sleeping in P(), so V() can skip the wakeup when there are none
+};
+
 class KernelSemaphore {
-	sem_t* sem;
-	int* value;
-	string name;
+	/* A process-shared counting semaphore kept inside a mapped segment the caller owns, built
+	   directly on a futex. Creating one touches no file and no system call, and P()/V() only
+	   enter the kernel when a process has to sleep or wake a sleeper.
+
+	   The shared word holds the change from the initial value rather than the value itself,
+	   so a freshly zero-filled segment is ready to use. Both processes pass the same _val,
+	   and neither has to initialize the segment before the other maps it. */
+	semaphore_state* state;
+	int initial;
 
 public:
-	KernelSemaphore(string name, int _val); 
+	KernelSemaphore(semaphore_state* _state, int _val); 
 	~KernelSemaphore();
 
 	void P();
 	void V();
 };
 
-#endif
\ No newline at end of file
+#endif
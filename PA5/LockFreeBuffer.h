@@ -0,0 +1,234 @@
+#ifndef LockFreeBuffer_h
+#define LockFreeBuffer_h
+
+#include "common.h"
+#include "RequestBuffer.h"
+#include <linux/futex.h>
+#include <new>
+#include <sched.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+#define LF_SPIN_LIMIT 128	// failed attempts before a thread sleeps on the futex
+#define LF_YIELD_LIMIT 4	// then yields before sleeping, letting the other side run
+#define LF_CACHE_LINE 64
+
+class LockFreeBuffer : public RequestBuffer
+{
+	/* Bounded multi-producer/multi-consumer ring of fixed-size slots (Vyukov's design). Each slot
+	   carries a sequence number that says whose turn it is: a producer claims position pos by
+	   advancing head when slot[pos].seq == pos, fills it and publishes seq = pos + 1; a consumer
+	   claims it when seq == pos + 1 and releases it for the next lap with seq = pos + capacity.
+	   Nothing is locked, so the only shared writes are the two position counters and the slot.
+	   reserve/commit and acquire/release expose the two halves of each step, so a message can
+	   be written and read in place.
+
+	   A thread that finds the ring full (or empty) spins a little, yields a few times and then
+	   sleeps on a futex word that is bumped after every pop (push); wakeups are only issued
+	   while someone sleeps, so a busy ring makes no system calls at all.
+	*/
+private:
+	struct Slot
+	{
+		unsigned long long seq;
+		int len;
+		char data[MAX_MESSAGE];
+	};
+
+	Slot* slots;
+	unsigned long long mask;	// capacity - 1 (the capacity is a power of two)
+	int spin_limit;				// LF_SPIN_LIMIT, or 0 on one CPU where spinning only burns the timeslice
+
+	alignas(LF_CACHE_LINE) unsigned long long head;	// next position to push
+	alignas(LF_CACHE_LINE) unsigned long long tail;	// next position to pop
+	alignas(LF_CACHE_LINE) unsigned int pushes;		// futex words, bumped after every push/pop
+	unsigned int push_sleepers;						// threads sleeping on pops (ring was full)
+	alignas(LF_CACHE_LINE) unsigned int pops;
+	unsigned int pop_sleepers;						// threads sleeping on pushes (ring was empty)
+
+	static void futex_wait(unsigned int* word, unsigned int seen){
+		syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+	}
+
+	static void futex_wake(unsigned int* word){
+		syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+
+	static void cpu_relax(){
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+
+	bool try_reserve(unsigned long long& pos){
+		pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+		while (true)
+		{
+			Slot* slot = &slots[pos & mask];
+			long long diff = (long long) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+			if (diff == 0)
+			{ // The slot is free for this lap, try to claim the position
+				if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+					return true;
+			}
+			else if (diff < 0)
+				return false; // still holds last lap's message: full
+			else
+				pos = __atomic_load_n(&head, __ATOMIC_RELAXED); // another producer got there first
+		}
+	}
+
+	bool try_acquire(unsigned long long& pos){
+		pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+		while (true)
+		{
+			Slot* slot = &slots[pos & mask];
+			long long diff = (long long) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+			if (diff == 0)
+			{
+				if (__atomic_compare_exchange_n(&tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+					return true;
+			}
+			else if (diff < 0)
+				return false; // not committed yet: empty
+			else
+				pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	template <class Claim>
+	unsigned long long claim(Claim try_claim, unsigned int* word, unsigned int* sleepers){
+		/* Retries try_claim until it succeeds: spinning, then yielding, then sleeping until word is
+		   bumped. The claim is re-checked after announcing the sleeper so a bump cannot be missed. */
+		unsigned long long pos;
+		for (int spins = 0; !try_claim(pos); spins++)
+		{
+			if (spins < spin_limit)
+			{
+				cpu_relax();
+				continue;
+			}
+			if (spins < spin_limit + LF_YIELD_LIMIT)
+			{
+				sched_yield();
+				continue;
+			}
+			unsigned int seen = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+			__atomic_fetch_add(sleepers, 1, __ATOMIC_SEQ_CST);
+			if (try_claim(pos))
+			{
+				__atomic_fetch_sub(sleepers, 1, __ATOMIC_SEQ_CST);
+				break;
+			}
+			futex_wait(word, seen);
+			__atomic_fetch_sub(sleepers, 1, __ATOMIC_SEQ_CST);
+		}
+		return pos;
+	}
+
+	void notify(unsigned int* word, unsigned int* sleepers){
+		__atomic_fetch_add(word, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(sleepers, __ATOMIC_SEQ_CST) > 0)
+			futex_wake(word);
+	}
+
+public:
+	LockFreeBuffer(int _cap){
+		unsigned long long capacity = 2; // the sequence scheme needs at least two slots
+		while (capacity < (unsigned long long) _cap)
+			capacity *= 2;
+		mask = capacity - 1;
+		spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? LF_SPIN_LIMIT : 0;
+
+		slots = new Slot[capacity];
+		for (unsigned long long i = 0; i < capacity; i++)
+		{
+			slots[i].seq = i;
+		}
+		head = tail = 0;
+		pushes = pops = 0;
+		push_sleepers = pop_sleepers = 0;
+	}
+
+	~LockFreeBuffer(){
+		delete[] slots;
+	}
+
+	static void* operator new(size_t size){
+		// plain new only guarantees 16 bytes under C++11, the members above need a cache line
+		void* p;
+		if (posix_memalign(&p, LF_CACHE_LINE, size) != 0)
+			throw bad_alloc();
+		return p;
+	}
+
+	static void operator delete(void* p){
+		free(p);
+	}
+
+	void reserve(BufferSlot& slot){
+		slot.ticket = claim([this](unsigned long long& pos) { return try_reserve(pos); }, &pops, &push_sleepers);
+		slot.data = slots[slot.ticket & mask].data;
+		slot.len = 0;
+	}
+
+	void commit(BufferSlot& slot){
+		Slot* s = &slots[slot.ticket & mask];
+		s->len = slot.len;
+		__atomic_store_n(&s->seq, slot.ticket + 1, __ATOMIC_RELEASE);
+		notify(&pushes, &pop_sleepers);
+	}
+
+	void acquire(BufferSlot& slot){
+		slot.ticket = claim([this](unsigned long long& pos) { return try_acquire(pos); }, &pushes, &pop_sleepers);
+		slot.data = slots[slot.ticket & mask].data;
+		slot.len = slots[slot.ticket & mask].len;
+	}
+
+	void release(BufferSlot& slot){
+		__atomic_store_n(&slots[slot.ticket & mask].seq, slot.ticket + mask + 1, __ATOMIC_RELEASE);
+		notify(&pops, &push_sleepers);
+	}
+
+	int pop_many(char* data, int* lens, int k){
+		/* Nothing to amortize but the wakeups: after the first message, take whatever else is
+		   already committed without waiting and notify producers once. */
+		unsigned long long pos = claim([this](unsigned long long& pos) { return try_acquire(pos); }, &pushes, &pop_sleepers);
+		int n = 0;
+		do
+		{
+			Slot* slot = &slots[pos & mask];
+			lens[n] = slot->len;
+			if (slot->len > 0)
+				memcpy(data + n * MAX_MESSAGE, slot->data, slot->len);
+			__atomic_store_n(&slot->seq, pos + mask + 1, __ATOMIC_RELEASE);
+		} while (lens[n++] > 0 && n < k && try_acquire(pos));
+		notify(&pops, &push_sleepers);
+		return n;
+	}
+
+	void push(char* data, int len){
+		if (len > MAX_MESSAGE)
+		{
+			EXITONERROR("LockFreeBuffer::push");
+		}
+
+		BufferSlot slot;
+		reserve(slot);
+		if (len > 0)
+			memcpy(slot.data, data, len);
+		slot.len = len;
+		commit(slot);
+	}
+
+	vector<char> pop(){
+		BufferSlot slot;
+		acquire(slot);
+		vector<char> result(slot.data, slot.data + slot.len);
+		release(slot);
+		return result;
+	}
+};
+
+#endif /* LockFreeBuffer_h */
@@ -0,0 +1,78 @@
+#ifndef RequestBuffer_h
+#define RequestBuffer_h
+
+#include "common.h"
+#include <vector>
+
+using namespace std;
+
+enum BUFFER_TYPE {MUTEX_BUFFER, SLOT_BUFFER, LOCK_FREE_BUFFER};
+
+struct BufferSlot
+{ // a message borrowed from a buffer between reserve() and commit() or acquire() and release()
+	char* data;					// MAX_MESSAGE bytes owned by the buffer
+	int len;					// bytes of data in use
+	unsigned long long ticket;	// identifies the slot to the buffer that handed it out
+};
+
+class RequestBuffer
+{
+	/* A bounded FIFO of messages shared by the client's request and worker threads.
+	   BoundedBuffer guards a queue with a mutex; SlotBuffer and LockFreeBuffer keep messages
+	   inline in preallocated slots and can hand those slots out directly (reserve/acquire). */
+public:
+	virtual ~RequestBuffer() {};
+
+	virtual void push(char* data, int len) = 0;
+	/* Blocks while the buffer is full, then appends a copy of len bytes (len 0 pushes the
+	   empty message the workers treat as "quit"). */
+
+	virtual vector<char> pop() = 0;
+	/* Blocks while the buffer is empty, then removes and returns the oldest message. */
+
+	virtual void push_many(char* data, int len, int count){
+		/* Pushes count messages of len bytes stored back to back in data, as push() would. Locking
+		   buffers move as many as fit under one lock acquisition and with one wakeup. */
+		for (int i = 0; i < count; i++)
+		{
+			push(data + i * len, len);
+		}
+	}
+
+	virtual int pop_many(char* data, int* lens, int k) = 0;
+	/* Blocks while the buffer is empty, then removes up to k of the messages already waiting
+	   (at least one) into data, MAX_MESSAGE bytes apart, and their lengths into lens. A batch
+	   ends after an empty quit message so each worker takes exactly one. Returns the number
+	   of messages removed. */
+
+	virtual void reserve(BufferSlot& slot){
+		/* Blocks while the buffer is full, then points slot.data at MAX_MESSAGE bytes the caller
+		   fills in place. Messages are delivered in reservation order, so every reserve() must be
+		   followed by commit(); consumers wait at an uncommitted slot.
+		   This default stages the message in a heap buffer; slot buffers override it. */
+		slot.data = new char[MAX_MESSAGE];
+		slot.len = 0;
+	}
+
+	virtual void commit(BufferSlot& slot){
+		/* Publishes the first slot.len bytes of a reserved slot. */
+		push(slot.data, slot.len);
+		delete[] slot.data;
+	}
+
+	virtual void acquire(BufferSlot& slot){
+		/* Blocks while the buffer is empty, then removes the oldest message and lends it to the
+		   caller as slot.data/slot.len until release(). */
+		vector<char>* msg = new vector<char>(pop());
+		slot.data = msg->data();
+		slot.len = msg->size();
+		slot.ticket = (unsigned long long) msg;
+	}
+
+	virtual void release(BufferSlot& slot){
+		/* Returns an acquired slot to the producers; slot.data must not be used afterwards. */
+		delete (vector<char>*) slot.ticket;
+	}
+};
+
+#endif /* RequestBuffer_h */
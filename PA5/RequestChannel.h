@@ -26,6 +26,66 @@ public:
 	virtual int cwrite ( char* msg, int msglen ) = 0;
 	/* Write the data to the channel. The function returns
 	the number of characters written to the channel. */
+
+	virtual char* cacquire ( int* len ){
+		/* Blocking read of one message, like cread, except that the message may be lent in
+		place instead of copied: it is valid until crelease, which must come before the next
+		read. This default reads a copy. */
+		return cread (len);
+	}
+
+	virtual void crelease ( char* msg ){
+		/* Ends the loan of a message returned by cacquire. */
+		delete[] msg;
+	}
+
+	virtual int cwrite_bulk ( char* data, int len ){
+		/* Write a payload of any size, which the other side must read with cread_bulk of the
+		same length. This default sends it as MAX_MESSAGE sized messages; channels that can
+		move large blocks directly override it. Returns len. */
+		for (int sent = 0; sent < len; sent += MAX_MESSAGE){
+			cwrite (data + sent, min (MAX_MESSAGE, len - sent));
+		}
+		return len;
+	}
+
+	virtual int cread_bulk ( char* buf, int len ){
+		/* Blocking read of a payload of exactly len bytes, written with cwrite_bulk, into buf.
+		Returns len. */
+		for (int received = 0; received < len; ){
+			int n = 0;
+			char* msg = cread (&n);
+			if (n <= 0)
+				EXITONERROR ("cread_bulk");
+			n = min (n, len - received);
+			memcpy (buf + received, msg, n);
+			received += n;
+			delete[] msg;
+		}
+		return len;
+	}
+
+	virtual int cwrite_file ( int fd, __int64_t offset, int len ){
+		/* Write len bytes of file fd, starting at offset, as a cwrite_bulk payload. This default
+		reads them into memory first; channels that can move file data without a user space
+		copy override it. Returns len. */
+		char* buf = new char [len];
+		if (pread (fd, buf, len, offset) != len)
+			EXITONERROR ("cwrite_file");
+		cwrite_bulk (buf, len);
+		delete[] buf;
+		return len;
+	}
+
+	virtual int cread_file ( int fd, __int64_t offset, int len ){
+		/* Read a len byte cwrite_bulk payload into file fd at offset. Returns len. */
+		char* buf = new char [len];
+		cread_bulk (buf, len);
+		if (pwrite (fd, buf, len, offset) != len)
+			EXITONERROR ("cread_file");
+		delete[] buf;
+		return len;
+	}
 };
 
 #endif
\ No newline at end of file
@@ -9,57 +9,73 @@ using namespace std;
 
 class SHMBoundedBuffer
 {
+	/* One region of size bytes in a shared memory segment, handed back and forth between a
+	   writer and a reader. The empty/full semaphores sit in front of the region in the same
+	   segment, so the buffer costs one /dev/shm object and no named semaphores. */
 private:
-
-	char* data;
+	struct header
+	{
+		semaphore_state empty_state, full_state;
+	};
+
+	char* segment;
+	char* data; // the region, just past the header
+	int size; // bytes of the region
 	int shm_id;
 	string shm_name;
 	KernelSemaphore *empty, *full;
 
 public:
-	SHMBoundedBuffer(string name){
-		string empty_name = name + "_empty";
-		string full_name = name + "_full";
-		
+	SHMBoundedBuffer(string name, int _size){
+		size = _size;
 		shm_name = "/shm_" + name;
 
-		empty = new KernelSemaphore(empty_name.c_str(), 1);
-		full = new KernelSemaphore(full_name.c_str(), 0);
-
 		shm_id = shm_open(shm_name.c_str(), O_RDWR | O_CREAT, 0666);
-		ftruncate(shm_id, MAX_MESSAGE);
-
-		data = (char*) mmap(NULL, MAX_MESSAGE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_id, 0);
+		if (shm_id < 0 || ftruncate(shm_id, sizeof(header) + size) < 0)
+		{
+			EXITONERROR(shm_name);
+		}
+
+		segment = (char*) mmap(NULL, sizeof(header) + size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_id, 0);
+		if (segment == MAP_FAILED)
+		{
+			EXITONERROR(shm_name);
+		}
+		close(shm_id); // the mapping stays valid without the descriptor
+
+		data = segment + sizeof(header);
+		empty = new KernelSemaphore(&((header*) segment)->empty_state, 1);
+		full = new KernelSemaphore(&((header*) segment)->full_state, 0);
 	}
 
 	~SHMBoundedBuffer(){
 		delete empty;
 		delete full;
 
-		close(shm_id);
-		munmap(data, MAX_MESSAGE);
+		munmap(segment, sizeof(header) + size);
 		
 		if (shm_unlink(shm_name.c_str()) < 0)
 			EXITONERROR(shm_name.c_str());
 	}
 
-	void push(char* msg, int len){
-		empty->P();
-		
-		memcpy(data, msg, len);
-
-		full->V();
+	void push_bulk(char* msg, int len){
+		// hand the payload over in pieces of up to size bytes
+		for (int sent = 0; sent < len; sent += size)
+		{
+			empty->P();
+			memcpy(data, msg + sent, min(size, len - sent));
+			full->V();
+		}
 	}
 
-	char* pop(){
-		full->P();
-
-		char* buf = new char[MAX_MESSAGE];
-
-		memcpy(buf, data, MAX_MESSAGE);
-
-		empty->V();
-		return buf;
+	void pop_bulk(char* buf, int len){
+		// the reader knows len, so it splits the payload into the same pieces
+		for (int received = 0; received < len; received += size)
+		{
+			full->P();
+			memcpy(buf + received, data, min(size, len - received));
+			empty->V();
+		}
 	}
 };
 
@@ -11,28 +11,70 @@ SHMRequestChannel::SHMRequestChannel(const string _name, const Side _side) : Req
 	string name2 = my_name + "_server";
 
 	shm_name = "/shm_" + ((my_side == SERVER_SIDE) ? name2 : name1);
-	client_buffer = new SHMBoundedBuffer(name1);
-	server_buffer = new SHMBoundedBuffer(name2);
+	client_buffer = new SHMRingBuffer(name1);
+	server_buffer = new SHMRingBuffer(name2);
+	client_bulk = server_bulk = NULL;
 }
 
 SHMRequestChannel::~SHMRequestChannel()
 { 
 	delete client_buffer;
 	delete server_buffer;
+	delete client_bulk;
+	delete server_bulk;
+}
+
+void SHMRequestChannel::open_bulk()
+{
+	if (client_bulk == NULL)
+	{
+		client_bulk = new SHMBoundedBuffer(my_name + "_client_bulk", SHM_BULK_REGION);
+		server_bulk = new SHMBoundedBuffer(my_name + "_server_bulk", SHM_BULK_REGION);
+	}
 }
 
 char* SHMRequestChannel::cread(int *len)
 {
-	char* buf = (my_side == CLIENT_SIDE) ? server_buffer->pop() : client_buffer->pop();
+	int length = 0;
+	char* buf = (my_side == CLIENT_SIDE) ? server_buffer->pop(&length) : client_buffer->pop(&length);
 
 	if(len != nullptr)
-		*len = sizeof(buf);
+		*len = length;
 
 	return buf;
 }
 
+char* SHMRequestChannel::cacquire(int *len)
+{
+	int length = 0;
+	char* msg = (my_side == CLIENT_SIDE) ? server_buffer->acquire(&length) : client_buffer->acquire(&length);
+
+	if(len != nullptr)
+		*len = length;
+
+	return msg;
+}
+
+void SHMRequestChannel::crelease(char *msg)
+{
+	(my_side == CLIENT_SIDE) ? server_buffer->release() : client_buffer->release();
+}
+
 int SHMRequestChannel::cwrite(char* msg, int len)
+{ // returns -1 for messages larger than a ring slot (MAX_MESSAGE); cwrite_bulk carries those
+	return (my_side == CLIENT_SIDE) ? client_buffer->push(msg, len) : server_buffer->push(msg, len);
+}
+
+int SHMRequestChannel::cwrite_bulk(char* data, int len)
 {
-	(my_side == CLIENT_SIDE) ? client_buffer->push(msg, len) : server_buffer->push(msg, len);
+	open_bulk();
+	(my_side == CLIENT_SIDE) ? client_bulk->push_bulk(data, len) : server_bulk->push_bulk(data, len);
+	return len;
 }
 
+int SHMRequestChannel::cread_bulk(char* buf, int len)
+{
+	open_bulk();
+	(my_side == CLIENT_SIDE) ? server_bulk->pop_bulk(buf, len) : client_bulk->pop_bulk(buf, len);
+	return len;
+}
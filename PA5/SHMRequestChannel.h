@@ -5,14 +5,22 @@
 #include "RequestChannel.h"
 #include "KernelSemaphore.h"
 #include "SHMBoundedBuffer.h"
+#include "SHMRingBuffer.h"
+
+#define SHM_BULK_REGION (4 << 20) // bytes of each direction's bulk transfer region
 
 class SHMRequestChannel : public RequestChannel
 {	
 private:
-	/* The current implementation uses shared memory. */
+	/* The current implementation uses shared memory. Each direction is a ring of
+	   SHM_RING_SLOTS messages, so a side can have many requests or replies in flight before it
+	   waits. Bulk payloads go through a second, SHM_BULK_REGION sized pair of buffers that
+	   both sides create on first use. */
 
 	string shm_name;
-	SHMBoundedBuffer *client_buffer, *server_buffer;
+	SHMRingBuffer *client_buffer, *server_buffer;
+	SHMBoundedBuffer *client_bulk, *server_bulk;
+	void open_bulk();
 
 public:
 	SHMRequestChannel(const string _name, const Side _side);
@@ -36,12 +44,24 @@ public:
 	 mechanisms associated with the channel. */
 
 	char* cread(int *len=NULL);
-	/* Blocking read of data from the channel. Returns a string of characters
-	 read from the channel. Returns NULL if read failed. */
+	/* Blocking read of one message from the channel. Returns a copy of the bytes written
+	 and sets *len to their number. */
+
+	char* cacquire(int *len);
+	/* Blocking read of one message, returned in place in the shared ring slot. */
+
+	void crelease(char *msg);
+	/* Hands the slot of the message returned by cacquire back to the writer. */
 
 	int cwrite(char *msg, int msglen);
 	/* Write the data to the channel. The function returns the number of characters written
 	 to the channel. */
+
+	int cwrite_bulk(char *data, int len);
+	/* Copies len bytes through the bulk region, SHM_BULK_REGION bytes at a time. */
+
+	int cread_bulk(char *buf, int len);
+	/* Copies exactly len bytes out of the bulk region into buf. */
 	 
 	string name(); 
 };
@@ -0,0 +1,148 @@
+#ifndef SHMRingBuffer_h
+#define SHMRingBuffer_h
+
+#include "common.h"
+#include <sys/mman.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+#define SHM_RING_SLOTS 64	// messages one direction of a channel can hold (a power of two)
+#define SHM_SPIN_LIMIT 128	// failed attempts before a side sleeps on the futex
+
+class SHMRingBuffer
+{
+	/* Single-producer/single-consumer ring of message slots in a shared memory segment. Each
+	   slot carries the length of its message, so readers copy only the bytes written, or read
+	   them in place between acquire() and release().
+	   The head and tail indices live in the segment too, so a message costs no system call
+	   unless one side has to wait: the consumer sleeps on the head word while the ring is
+	   empty, the producer on the tail word while it is full, and each side only issues a
+	   wakeup when the other has announced that it sleeps.
+
+	   The indices run freely and are reduced modulo SHM_RING_SLOTS. A new segment is zero
+	   filled, which is exactly the empty ring, so whichever side maps it first needs no setup.
+	   Several threads may share one end only if they serialize their calls. */
+private:
+	struct ring
+	{
+		alignas(64) unsigned int head;	// next slot the producer fills
+		unsigned int consumer_sleeping;
+		alignas(64) unsigned int tail;	// next slot the consumer empties
+		unsigned int producer_sleeping;
+		alignas(64) struct
+		{
+			int len;
+			alignas(8) char data[MAX_MESSAGE]; // read in place as datamsg, double or pipedreply
+		} slots[SHM_RING_SLOTS];
+	};
+
+	ring* r;
+	int shm_id;
+	string shm_name;
+	int spin_limit; // SHM_SPIN_LIMIT, or 0 on one CPU where spinning only burns the timeslice
+
+	static void futex_wait(unsigned int* word, unsigned int seen){
+		syscall(SYS_futex, word, FUTEX_WAIT, seen, NULL, NULL, 0);
+	}
+
+	static void futex_wake(unsigned int* word){
+		syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+	}
+
+	void wait_while_equal(unsigned int* word, unsigned int seen, unsigned int* sleeping){
+		/* Returns once *word != seen: spins first, then announces itself in *sleeping and sleeps
+		   until the other side changes the word. */
+		for (int spins = 0; __atomic_load_n(word, __ATOMIC_ACQUIRE) == seen; spins++)
+		{
+			if (spins < spin_limit)
+				continue;
+			__atomic_store_n(sleeping, 1, __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == seen)
+				futex_wait(word, seen);
+			__atomic_store_n(sleeping, 0, __ATOMIC_SEQ_CST);
+		}
+	}
+
+	void publish(unsigned int* word, unsigned int value, unsigned int* sleeping){
+		__atomic_store_n(word, value, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(sleeping, __ATOMIC_SEQ_CST))
+			futex_wake(word);
+	}
+
+public:
+	SHMRingBuffer(string name){
+		shm_name = "/shm_" + name;
+		spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_SPIN_LIMIT : 0;
+
+		shm_id = shm_open(shm_name.c_str(), O_RDWR | O_CREAT, 0666);
+		if (shm_id < 0 || ftruncate(shm_id, sizeof(ring)) < 0)
+		{
+			EXITONERROR(shm_name);
+		}
+
+		r = (ring*) mmap(NULL, sizeof(ring), PROT_READ | PROT_WRITE, MAP_SHARED, shm_id, 0);
+		if (r == MAP_FAILED)
+		{
+			EXITONERROR(shm_name);
+		}
+		close(shm_id); // the mapping stays valid without the descriptor
+	}
+
+	~SHMRingBuffer(){
+		munmap(r, sizeof(ring));
+
+		if (shm_unlink(shm_name.c_str()) < 0)
+			EXITONERROR(shm_name.c_str());
+	}
+
+	int push(char* msg, int len){
+		/* Blocks while the ring is full, then appends a copy of the message. Returns len, or -1
+		   without writing anything if the message does not fit a slot. */
+		if (len < 0 || len > MAX_MESSAGE)
+			return -1;
+
+		unsigned int head = r->head; // only this side writes head
+		unsigned int tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		if (head - tail == SHM_RING_SLOTS)
+		{ // full: wait for the consumer to free a slot
+			wait_while_equal(&r->tail, tail, &r->producer_sleeping);
+		}
+
+		r->slots[head % SHM_RING_SLOTS].len = len;
+		memcpy(r->slots[head % SHM_RING_SLOTS].data, msg, len);
+		publish(&r->head, head + 1, &r->consumer_sleeping);
+		return len;
+	}
+
+	char* acquire(int* len){
+		/* Blocks while the ring is empty, then returns the oldest message in place and its length
+		   in *len. The slot stays the consumer's until release(). */
+		unsigned int tail = r->tail; // only this side writes tail
+		unsigned int head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		if (head == tail)
+		{ // empty: wait for the producer to fill a slot
+			wait_while_equal(&r->head, head, &r->consumer_sleeping);
+		}
+
+		*len = r->slots[tail % SHM_RING_SLOTS].len;
+		return r->slots[tail % SHM_RING_SLOTS].data;
+	}
+
+	void release(){
+		/* Hands the acquired slot back to the producer. */
+		publish(&r->tail, r->tail + 1, &r->producer_sleeping);
+	}
+
+	char* pop(int* len){
+		/* Removes the oldest message into a new MAX_MESSAGE buffer, copying only its *len bytes. */
+		char* buf = new char[MAX_MESSAGE];
+		char* msg = acquire(len);
+		memcpy(buf, msg, *len);
+		release();
+		return buf;
+	}
+};
+
+#endif /* SHMRingBuffer_h */
@@ -0,0 +1,186 @@
+#ifndef SlotBuffer_h
+#define SlotBuffer_h
+
+#include "common.h"
+#include "RequestBuffer.h"
+
+using namespace std;
+
+class SlotBuffer : public RequestBuffer
+{
+	/* BoundedBuffer with its messages stored inline: cap fixed-size slots allocated once and
+	   used as a ring. Producers fill the slot at head in place and consumers read the slot at
+	   tail in place, so moving a request costs no heap allocation and, through reserve/acquire,
+	   no copy. Slots are handed out in ring order but may be committed and released out of
+	   order, so each slot carries its own state and a waiter only proceeds when the slot it is
+	   next in line for is ready. */
+private:
+	enum SLOT_STATE {SLOT_FREE, SLOT_WRITING, SLOT_READY, SLOT_READING};
+
+	struct Slot
+	{
+		SLOT_STATE state;
+		int len;
+		char data[MAX_MESSAGE];
+	};
+
+	int cap;
+	Slot* slots;
+	unsigned long long head;	// next slot to reserve
+	unsigned long long tail;	// next slot to acquire
+	pthread_mutex_t mtx;
+	pthread_cond_t cond1, cond2;	// slot at tail became ready / slot at head became free
+
+public:
+	SlotBuffer(int _cap){
+		cap = _cap;
+		slots = new Slot[cap];
+		for (int i = 0; i < cap; i++)
+		{
+			slots[i].state = SLOT_FREE;
+		}
+		head = tail = 0;
+		pthread_mutex_init(&mtx, NULL);
+		pthread_cond_init(&cond1, NULL);
+		pthread_cond_init(&cond2, NULL);
+	}
+
+	~SlotBuffer(){
+		pthread_mutex_destroy(&mtx);
+		pthread_cond_destroy(&cond1);
+		pthread_cond_destroy(&cond2);
+		delete[] slots;
+	}
+
+	void reserve(BufferSlot& slot){
+		pthread_mutex_lock(&mtx);
+		while (slots[head % cap].state != SLOT_FREE)
+		{
+			pthread_cond_wait(&cond2, &mtx);
+		}
+
+		slot.ticket = head % cap;
+		slots[slot.ticket].state = SLOT_WRITING;
+		head++;
+		if (slots[head % cap].state == SLOT_FREE) // pass on a wakeup meant for the slot just taken
+			pthread_cond_signal(&cond2);
+		pthread_mutex_unlock(&mtx);
+
+		slot.data = slots[slot.ticket].data;
+		slot.len = 0;
+	}
+
+	void commit(BufferSlot& slot){
+		pthread_mutex_lock(&mtx);
+		slots[slot.ticket].len = slot.len;
+		slots[slot.ticket].state = SLOT_READY;
+		pthread_cond_signal(&cond1);
+		pthread_mutex_unlock(&mtx);
+	}
+
+	void acquire(BufferSlot& slot){
+		pthread_mutex_lock(&mtx);
+		while (slots[tail % cap].state != SLOT_READY)
+		{
+			pthread_cond_wait(&cond1, &mtx);
+		}
+
+		slot.ticket = tail % cap;
+		slots[slot.ticket].state = SLOT_READING;
+		tail++;
+		if (slots[tail % cap].state == SLOT_READY)
+			pthread_cond_signal(&cond1);
+		pthread_mutex_unlock(&mtx);
+
+		slot.data = slots[slot.ticket].data;
+		slot.len = slots[slot.ticket].len;
+	}
+
+	void release(BufferSlot& slot){
+		pthread_mutex_lock(&mtx);
+		slots[slot.ticket].state = SLOT_FREE;
+		pthread_cond_signal(&cond2);
+		pthread_mutex_unlock(&mtx);
+	}
+
+	void push_many(char* data, int len, int count){
+		if (len > MAX_MESSAGE)
+		{
+			EXITONERROR("SlotBuffer::push_many");
+		}
+
+		pthread_mutex_lock(&mtx);
+		while (count > 0)
+		{
+			while (slots[head % cap].state != SLOT_FREE)
+			{
+				pthread_cond_wait(&cond2, &mtx);
+			}
+
+			for (; count > 0 && slots[head % cap].state == SLOT_FREE; count--, data += len)
+			{ // fill every free slot in line before waking anyone
+				Slot* slot = &slots[head % cap];
+				if (len > 0)
+					memcpy(slot->data, data, len);
+				slot->len = len;
+				slot->state = SLOT_READY;
+				head++;
+			}
+			pthread_cond_signal(&cond1);
+		}
+		if (slots[head % cap].state == SLOT_FREE)
+			pthread_cond_signal(&cond2);
+		pthread_mutex_unlock(&mtx);
+	}
+
+	int pop_many(char* data, int* lens, int k){
+		pthread_mutex_lock(&mtx);
+		while (slots[tail % cap].state != SLOT_READY)
+		{
+			pthread_cond_wait(&cond1, &mtx);
+		}
+
+		int n = 0;
+		while (n < k && slots[tail % cap].state == SLOT_READY)
+		{
+			Slot* slot = &slots[tail % cap];
+			lens[n] = slot->len;
+			if (slot->len > 0)
+				memcpy(data + n * MAX_MESSAGE, slot->data, slot->len);
+			slot->state = SLOT_FREE;
+			tail++;
+			if (lens[n++] == 0) // a quit message ends the batch
+				break;
+		}
+
+		pthread_cond_signal(&cond2);
+		if (slots[tail % cap].state == SLOT_READY) // leave the rest of the backlog to another consumer
+			pthread_cond_signal(&cond1);
+		pthread_mutex_unlock(&mtx);
+		return n;
+	}
+
+	void push(char* data, int len){
+		if (len > MAX_MESSAGE)
+		{
+			EXITONERROR("SlotBuffer::push");
+		}
+
+		BufferSlot slot;
+		reserve(slot);
+		if (len > 0)
+			memcpy(slot.data, data, len);
+		slot.len = len;
+		commit(slot);
+	}
+
+	vector<char> pop(){
+		BufferSlot slot;
+		acquire(slot);
+		vector<char> result(slot.data, slot.data + slot.len);
+		release(slot);
+		return result;
+	}
+};
+
+#endif /* SlotBuffer_h */
@@ -1,5 +1,7 @@
 #include "common.h"
 #include "BoundedBuffer.h"
+#include "SlotBuffer.h"
+#include "LockFreeBuffer.h"
 #include "Histogram.h"
 #include "common.h"
 #include "HistogramCollection.h"
@@ -7,6 +9,7 @@
 #include "MQRequestChannel.h"
 #include "SHMRequestChannel.h"
 #include <sys/wait.h>
+#include <sys/resource.h>
 
 using namespace std;
 
@@ -18,13 +21,17 @@ struct patient_thread_args
 {
     int n; // number of datapoints [0-15000]
     int patient; // which patient [1-15]
-	BoundedBuffer* request_buffer;
+	int k; // most messages moved per buffer operation
+	int g; // data points per request (1: one datamsg per point, otherwise rangemsgs)
+	RequestBuffer* request_buffer;
 };
 
 struct worker_thread_args
 {
 	vector<Histogram*>* hists; // one histogram per patient
-	BoundedBuffer* request_buffer;
+	int g; // most data points in a range reply
+	int d; // most requests in flight on the channel (1: wait for each reply)
+	RequestBuffer* request_buffer;
 	RequestChannel* request_channel; // every worker has its own channel
 	pthread_mutex_t* mtx; // avoid race conditions updating histograms
 };
@@ -32,17 +39,19 @@ struct worker_thread_args
 struct filereq_thread_args
 {
 	string f; // name of input file
-    int m; // max buffer size (BREAKS IF > 256)
+    int m; // chunk size (bulk requests above MAX_MESSAGE)
+	bool splice; // bulk requests are spliced from file to channel to file
 	__int64_t file_size; // size of input file
-	BoundedBuffer* request_buffer; 
+	RequestBuffer* request_buffer; 
 };
 
 struct fileworker_thread_args
 {
 	string f; // name of input file (for message size)
+	int m; // largest chunk requested (bulk requests above MAX_MESSAGE)
 	int fd; // descriptor of output file
 	RequestChannel* request_channel; // every worker has its own channel
-	BoundedBuffer* request_buffer;
+	RequestBuffer* request_buffer;
 	pthread_mutex_t* mtx; // avoid race conditions writing to output file
 };
 
@@ -50,15 +59,36 @@ void* patient_thread_function(void* arg)
 { // sends server requests for patient ECG information to a bounded buffer
 	struct patient_thread_args* arguments;
 	arguments = (struct patient_thread_args*) arg; // collect args
-	char* msg = new char[sizeof(datamsg)];
+	BufferSlot slot;
+	datamsg* batch = (datamsg*) new char[arguments->k * sizeof(datamsg)];
 
-	for(int i = 0; i < arguments->n; i++) 
+	for(int i = 0; arguments->g > 1 && i < arguments->n; i += arguments->g) 
+	{ // ask for g points at a time
+		rangemsg msg(arguments->patient, (double) i * (60.0 / 15000.0), min(arguments->g, arguments->n - i), 1);
+		arguments->request_buffer->push((char*) &msg, sizeof(rangemsg));
+	}
+
+	for(int i = 0; arguments->g == 1 && i < arguments->n; ) 
 	{
-		*(datamsg*) msg = datamsg(arguments->patient, (double) i * (60.0 / 15000.0), 1); // format new message and push to buffer
-        arguments->request_buffer->push(msg, sizeof(datamsg));      
+		if (arguments->k == 1)
+		{ // format the message directly in its buffer slot
+			arguments->request_buffer->reserve(slot);
+			*(datamsg*) slot.data = datamsg(arguments->patient, (double) i * (60.0 / 15000.0), 1);
+			slot.len = sizeof(datamsg);
+			arguments->request_buffer->commit(slot);
+			i++;
+			continue;
+		}
+
+		int count = 0;
+		for(; count < arguments->k && i < arguments->n; count++, i++)
+		{ // format up to k messages and push them under one lock
+			batch[count] = datamsg(arguments->patient, (double) i * (60.0 / 15000.0), 1);
+		}
+		arguments->request_buffer->push_many((char*) batch, sizeof(datamsg), count);
 	}
 
-	delete[] msg;
+	delete[] (char*) batch;
     pthread_exit(NULL);
 }
 
@@ -66,24 +96,97 @@ void* worker_thread_function(void* arg)
 { 
 	struct worker_thread_args* arguments;
 	arguments = (struct worker_thread_args*) arg; // collect args
+	BufferSlot slot;
+	double* points = (arguments->g * sizeof(double) > MAX_MESSAGE) ? new double[arguments->g] : NULL; // receives bulk range replies
 
 	while(true)
-	{
-		vector<char> ret_msg = arguments->request_buffer->pop(); // pop message from buffer
-		if (ret_msg.size() == 0) // if worker pops quit message, exit
+	{ // one request at a time: each waits a full round trip, so a backlog held here would idle the other workers
+		arguments->request_buffer->acquire(slot);
+		if (slot.len == 0) // if worker pops quit message, exit
+		{
+			arguments->request_buffer->release(slot);
 			break;
-		char* msg = ret_msg.data();
-		
-		arguments->request_channel->cwrite( msg, sizeof(datamsg)); // write message to req channel 
+		}
+		char* msg = slot.data;
+
+		if (*(MESSAGE_TYPE*) msg == RANGE_DATA_MSG)
+		{ // one reply carries all the points of the range
+			rangemsg range = *(rangemsg*) msg;
+			arguments->request_buffer->release(slot);
+			arguments->request_channel->cwrite((char*) &range, sizeof(rangemsg));
+			bool bulk = range.count * sizeof(double) > MAX_MESSAGE; // the server sends larger replies as a bulk payload
+			double* results = points;
+			if (bulk)
+				arguments->request_channel->cread_bulk((char*) points, range.count * sizeof(double));
+			else
+				results = (double*) arguments->request_channel->cacquire(NULL);
+
+			pthread_mutex_lock(arguments->mtx);
+			for (int j = 0; j < range.count; j++)
+			{
+				(arguments->hists->at(range.person - 1))->update(results[j]);
+			}
+			pthread_mutex_unlock(arguments->mtx);
+
+			if (!bulk)
+				arguments->request_channel->crelease((char*) results);
+			continue;
+		}
 
-		double* result = (double*) arguments->request_channel->cread(); // read result
+		datamsg request = *(datamsg*) msg;
+		arguments->request_buffer->release(slot); // free the slot for the producers before the round trip
+		arguments->request_channel->cwrite((char*) &request, sizeof(datamsg)); // write message to req channel 
+
+		double* result = (double*) arguments->request_channel->cacquire(NULL); // read result in place where the channel allows it
 
 		pthread_mutex_lock(arguments->mtx);
-		(arguments->hists->at(((datamsg*) msg)->person - 1))->update(*result); // update patient's histogram (avoids race conditions)
+		(arguments->hists->at(request.person - 1))->update(*result); // update patient's histogram (avoids race conditions)
 		pthread_mutex_unlock(arguments->mtx);
 
-		delete[] result;
+		arguments->request_channel->crelease((char*) result);
+	}
+
+	delete[] points;
+	pthread_exit(NULL);
+}
+
+void* pipelined_worker_thread_function(void* arg)
+{ // like worker_thread_function, but sends a whole batch before reading the replies, which may come back in any order
+	struct worker_thread_args* arguments;
+	arguments = (struct worker_thread_args*) arg; // collect args
+	char* batch = new char[arguments->d * MAX_MESSAGE];
+	int lens[arguments->d];
+	bool quit = false;
+
+	while(!quit)
+	{
+		int count = arguments->request_buffer->pop_many(batch, lens, arguments->d); // up to d requests of backlog
+		if (lens[count - 1] == 0) // a quit message is always last in a batch
+		{
+			quit = true;
+			count--;
+		}
+
+		for (int i = 0; i < count; i++)
+		{ // the request's index in the batch is its id
+			pipedmsg msg(i, *(datamsg*) (batch + i * MAX_MESSAGE));
+			arguments->request_channel->cwrite((char*) &msg, sizeof(pipedmsg));
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			pipedreply* reply = (pipedreply*) arguments->request_channel->cacquire(NULL); // read results as they come
+			datamsg* request = (datamsg*) (batch + reply->id * MAX_MESSAGE);
+
+			pthread_mutex_lock(arguments->mtx);
+			(arguments->hists->at(request->person - 1))->update(reply->data); // update patient's histogram (avoids race conditions)
+			pthread_mutex_unlock(arguments->mtx);
+
+			arguments->request_channel->crelease((char*) reply);
+		}
 	}
+
+	delete[] batch;
 	pthread_exit(NULL);
 }
 
@@ -91,19 +194,27 @@ void* filereq_thread_function(void* arg)
 { // sends server requests for file data to a bounded buffer
 	struct filereq_thread_args* arguments;
 	arguments = (struct filereq_thread_args*) arg; // collect args
-	char* msg = new char[sizeof(filemsg) + arguments->f.length()];
+	int len = sizeof(filemsg) + arguments->f.length() + 1;
+	char* msg = new char[len];
+	strcpy(msg + sizeof(filemsg), arguments->f.c_str()); // append filename to request
 
 	for(__int64_t offset = 0; offset < arguments->file_size; offset += arguments->m)
 	{ // Request file in increments of m bytes
 		int buf_size = (offset + arguments->m < arguments->file_size) ? arguments->m : arguments->file_size - offset; // Determine how much can be requested
-		*(filemsg*) msg = filemsg(offset, buf_size); // format request
-
-		for(int i = 0; i < arguments->f.length(); i++)
-		{ // append filename to request
-			*(msg + sizeof(filemsg) + i) = arguments->f[i];
+		if (arguments->m > MAX_MESSAGE && arguments->splice)
+		{
+			*(splicefilemsg*) msg = splicefilemsg(offset, buf_size);
+		}
+		else if (arguments->m > MAX_MESSAGE)
+		{ // chunks too large for a message come back as a bulk payload
+			*(bulkfilemsg*) msg = bulkfilemsg(offset, buf_size);
+		}
+		else
+		{
+			*(filemsg*) msg = filemsg(offset, buf_size); // format request
 		}
 
-		arguments->request_buffer->push(msg, sizeof(filemsg) + sizeof(arguments->f)); // send request to buffer
+		arguments->request_buffer->push(msg, len); // send request to buffer
 	}
 
 	delete[] msg;
@@ -114,6 +225,7 @@ void* fileworker_thread_function(void* arg)
 {
 	struct fileworker_thread_args* arguments;
 	arguments = (struct fileworker_thread_args*) arg; // collect args
+	char* chunk = (arguments->m > MAX_MESSAGE) ? new char[arguments->m] : NULL; // receives bulk payloads
 
 	int fd = open(arguments->f.c_str(), O_CREAT | O_WRONLY | O_NDELAY, S_IWUSR | S_IRUSR);
 
@@ -124,33 +236,48 @@ void* fileworker_thread_function(void* arg)
 			break;
 		char* msg = ret_msg.data();
 
-		arguments->request_channel->cwrite( msg, sizeof(filemsg) + sizeof(arguments->f)); // write message to req channel 
-
-		char* result = arguments->request_channel->cread(); // read result
+		arguments->request_channel->cwrite( msg, ret_msg.size()); // write message to req channel 
 
 		__int64_t offset = ((filemsg*) msg)->offset; // determine offset and buffer size from message
 		int bufsize = ((filemsg*) msg)->length;
 		
-		pwrite(fd, result, bufsize, offset);
+		if (((filemsg*) msg)->mtype == FILE_SPLICE_MSG)
+		{ // straight from the channel into the output file
+			arguments->request_channel->cread_file(fd, offset, bufsize);
+		}
+		else if (((filemsg*) msg)->mtype == FILE_BULK_MSG)
+		{
+			arguments->request_channel->cread_bulk(chunk, bufsize); // read result
+			pwrite(fd, chunk, bufsize, offset);
+		}
+		else
+		{
+			char* result = arguments->request_channel->cacquire(NULL); // read result
+			pwrite(fd, result, bufsize, offset);
+			arguments->request_channel->crelease(result);
+		}
 
-		delete result;
 		pthread_mutex_lock(arguments->mtx); // avoid race conditions updating shared resources
 		TRANSFERRED_SIZE += bufsize; // update amout transferred for the console updater  
 		pthread_mutex_unlock(arguments->mtx);
 	}
 
+	delete[] chunk;
 	close(fd);
 	pthread_exit(NULL);
 }
 
-void parseArgs(int& argc, char* argv[], string& f, int& n, int& p, int& w, int& b, int& m, CHANNEL_TYPE& chan_type)
+void parseArgs(int& argc, char* argv[], string& f, int& n, int& p, int& w, int& b, int& m, int& k, int& d, int& g, bool& z, CHANNEL_TYPE& chan_type, BUFFER_TYPE& buf_type)
 {
 	int opt = 0;
-	while ((opt = getopt(argc, argv, "n:p:w:b:f:m:i:")) != -1)
+	while ((opt = getopt(argc, argv, "n:p:w:b:f:m:i:r:k:d:g:z")) != -1)
 	{ // while options were received from getopt
-		int arg = atoi(optarg);
+		int arg = (optarg != NULL) ? atoi(optarg) : 0;
 		switch (opt)
 		{	
+			case 'z': // if file chunks should be spliced (zero-copy, needs -m above MAX_MESSAGE)
+				z = true;
+				break;
 			case 'f': // if filename is specified for file transfers
 				f = optarg;
 				break;
@@ -188,13 +315,37 @@ void parseArgs(int& argc, char* argv[], string& f, int& n, int& p, int& w, int&
 				b = arg;
 				break;
 			case 'm': // if maximum message size file file transfers is specified
-				if (arg < 1 || arg > 1000)
+				if (arg < 1 || arg > MAX_BULK_CHUNK)
 				{
-					printf("ERROR: Max message size out of acceptable range! [1-1000]\n");
+					printf("ERROR: Max message size out of acceptable range! [1-%d]\n", MAX_BULK_CHUNK);
 					exit(EXIT_FAILURE);
 				}
 				m = arg;
 				break;
+			case 'k': // if batch size for data requests is specified
+				if (arg < 1 || arg > 1000)
+				{
+					printf("ERROR: Batch size out of acceptable range! [1-1000]\n");
+					exit(EXIT_FAILURE);
+				}
+				k = arg;
+				break;
+			case 'g': // if data points per request are specified
+				if (arg < 1 || arg > 15000)
+				{ // (and at most m / sizeof(double), checked once m is known)
+					printf("ERROR: Data points per request out of acceptable range! [1-15000]\n");
+					exit(EXIT_FAILURE);
+				}
+				g = arg;
+				break;
+			case 'd': // if pipeline depth for data requests is specified
+				if (arg < 1 || arg > MAX_PIPELINE)
+				{
+					printf("ERROR: Pipeline depth out of acceptable range! [1-%d]\n", MAX_PIPELINE);
+					exit(EXIT_FAILURE);
+				}
+				d = arg;
+				break;
 			case 'i': // if maximum message size file file transfers is specified
 				switch(tolower(optarg[0]))
 				{
@@ -213,6 +364,24 @@ void parseArgs(int& argc, char* argv[], string& f, int& n, int& p, int& w, int&
 						break;
 				}
 				break;
+			case 'r': // if request buffer implementation is specified
+				switch(tolower(optarg[0]))
+				{
+					case 'm':
+						buf_type = MUTEX_BUFFER;
+						break;
+					case 's':
+						buf_type = SLOT_BUFFER;
+						break;
+					case 'l':
+						buf_type = LOCK_FREE_BUFFER;
+						break;
+					default:
+						printf("ERROR: Buffer type not defined for %c, valid characters are m, s, l.\n", tolower(optarg[0]));
+						exit(EXIT_FAILURE);
+						break;
+				}
+				break;
 			case '?': // if unknown, end the program (getopt produces its own error message)
 				exit(EXIT_FAILURE);
 		}
@@ -232,7 +401,7 @@ void update_console(int sig)
 	}
 }
 
-void handle_data_request(int n, int p, int w, RequestChannel* chan, CHANNEL_TYPE chan_type, BoundedBuffer& request_buffer) 
+void handle_data_request(int n, int p, int w, int k, int d, int g, RequestChannel* chan, CHANNEL_TYPE chan_type, RequestBuffer& request_buffer) 
 { // creates p patient threads and w worker threads to collect patient ECG data from server using a buffer
 	pthread_t patient_threads[p];
 	pthread_t worker_threads[w];
@@ -246,6 +415,8 @@ void handle_data_request(int n, int p, int w, RequestChannel* chan, CHANNEL_TYPE
 	{ // create p patient threads
 		patient_args[i].n = n;
 		patient_args[i].patient = i + 1;
+		patient_args[i].k = k;
+		patient_args[i].g = g;
 		patient_args[i].request_buffer = &request_buffer;
 		pthread_create(&patient_threads[i], NULL, patient_thread_function, (void*) &patient_args[i]);
 		hists.push_back(new Histogram(36, -8, 7.5));
@@ -275,9 +446,11 @@ void handle_data_request(int n, int p, int w, RequestChannel* chan, CHANNEL_TYPE
 		}	
 		delete[] channel_name;
 		worker_args[i].hists = &hists;
+		worker_args[i].g = g;
+		worker_args[i].d = d;
 		worker_args[i].request_buffer = &request_buffer;
 		worker_args[i].mtx = &mtx;
-		pthread_create(&worker_threads[i], NULL, worker_thread_function, (void*) &worker_args[i]);
+		pthread_create(&worker_threads[i], NULL, (d > 1) ? pipelined_worker_thread_function : worker_thread_function, (void*) &worker_args[i]);
 		delete msg;
 	}
 
@@ -306,7 +479,7 @@ void handle_data_request(int n, int p, int w, RequestChannel* chan, CHANNEL_TYPE
 	pthread_mutex_destroy(&mtx);
 }
 
-void handle_file_request(string f, int m, int w, RequestChannel* chan, CHANNEL_TYPE chan_type, BoundedBuffer& request_buffer) 
+void handle_file_request(string f, int m, bool z, int w, RequestChannel* chan, CHANNEL_TYPE chan_type, RequestBuffer& request_buffer) 
 { // creates a file request thread and w worker threads to transfer a file via a server using a buffer
 	pthread_t filereq_thread;
 	pthread_t worker_threads[w];
@@ -315,14 +488,17 @@ void handle_file_request(string f, int m, int w, RequestChannel* chan, CHANNEL_T
 	pthread_mutex_t mtx;
 	pthread_mutex_init(&mtx, NULL);
 
-	char* msg = new char[sizeof(filemsg) + f.length()];
-	*(filemsg*) msg = filemsg(0, 0); // format file size request
-	for(int i = 0; i < f.length(); i++)
-	{ // append filename to request
-		*(msg + sizeof(filemsg) + i) = f[i];
+	int len = sizeof(filemsg) + f.length() + 1;
+	if (len > MAX_MESSAGE)
+	{
+		printf("ERROR: File name %s is too long for a request!\n", f.c_str());
+		exit(EXIT_FAILURE);
 	}
+	char* msg = new char[len];
+	*(filemsg*) msg = filemsg(0, 0); // format file size request
+	strcpy(msg + sizeof(filemsg), f.c_str()); // append filename to request
 	
-	chan->cwrite(msg, sizeof(filemsg) + sizeof(f)); // send request to dataserver
+	chan->cwrite(msg, len); // send request to dataserver
 	__uint64_t* result = (__uint64_t*) chan->cread();
 	FILE_SIZE = *result; // read response
 	delete result;
@@ -331,6 +507,7 @@ void handle_file_request(string f, int m, int w, RequestChannel* chan, CHANNEL_T
 	// create a file request thread
 	filereq_args.f = f;
 	filereq_args.m = m;
+	filereq_args.splice = z;
 	filereq_args.file_size = FILE_SIZE;
 	filereq_args.request_buffer = &request_buffer;
 
@@ -362,6 +539,7 @@ void handle_file_request(string f, int m, int w, RequestChannel* chan, CHANNEL_T
 		worker_args[i].mtx = &mtx;
 		worker_args[i].fd = fd;
 		worker_args[i].f = f;
+		worker_args[i].m = m;
 		pthread_create(&worker_threads[i], NULL, fileworker_thread_function, (void*) &worker_args[i]);
 		delete msg;
 	}
@@ -395,16 +573,37 @@ int main(int argc, char *argv[])
     int w = 100;    // default number of worker threads
     int b = 1;   	// default capacity of the request buffer, you should change this default
 	int m = 256; 	// default capacity of the file buffer
+	int k = 16;		// most data requests a patient thread pushes per buffer operation (1 disables batching)
+	int d = 1;		// data requests in flight per channel (1 disables pipelining)
+	int g = 1;		// data points per data request (1: one datamsg per point)
+	bool z = false;	// splice file chunks instead of copying them
 	CHANNEL_TYPE chan_type = FIFO;
+	BUFFER_TYPE buf_type = SLOT_BUFFER; // request buffer implementation (-r m|s|l)
 	RequestChannel* chan;
+	RequestBuffer* request_buffer;
     srand(time_t(NULL));
     
-	parseArgs(argc, argv, f, n, p, w, b, m, chan_type);
+	parseArgs(argc, argv, f, n, p, w, b, m, k, d, g, z, chan_type, buf_type);
+	if (z && m <= MAX_MESSAGE)
+	{
+		printf("ERROR: Spliced transfers (-z) need chunks larger than %d bytes (-m)!\n", MAX_MESSAGE);
+		exit(EXIT_FAILURE);
+	}
+	if (g * sizeof(double) > m)
+	{
+		printf("ERROR: %d data points per request do not fit in %d byte messages (-m)!\n", g, m);
+		exit(EXIT_FAILURE);
+	}
+	if (g > 1 && d > 1)
+	{
+		printf("ERROR: Range requests (-g) cannot be pipelined (-d)!\n");
+		exit(EXIT_FAILURE);
+	}
 
     int pid = fork();
     if (pid == 0)
 	{
-		char str1[sizeof(m)]; // create a string large enough to hold m
+		char str1[16]; // create a string large enough to hold m
 		snprintf(str1, sizeof(str1), "%d", m); // copy m's data to the new string
 		char str2[sizeof(CHANNEL_TYPE)];
 		snprintf(str2, sizeof(str2), "%d", chan_type);
@@ -425,7 +624,18 @@ int main(int argc, char *argv[])
 			break;
 	}
 	sleep(1); // TODO remove
-    BoundedBuffer request_buffer(b);
+	switch(buf_type)
+	{
+		case MUTEX_BUFFER:
+			request_buffer = new BoundedBuffer(b);
+			break;
+		case SLOT_BUFFER:
+			request_buffer = new SlotBuffer(b);
+			break;
+		case LOCK_FREE_BUFFER:
+			request_buffer = new LockFreeBuffer(b);
+			break;
+	}
 	
 	struct sigaction action;
 	struct sigevent clock_sig_event; 
@@ -453,24 +663,34 @@ int main(int argc, char *argv[])
 	assert(timer_settime(t_id, NULL, &t_val, NULL) == 0);
 
     struct timeval start, end;
+	struct rusage usage_start, usage_end; // context switches of all client threads
     gettimeofday (&start, 0);
+	getrusage(RUSAGE_SELF, &usage_start);
 
 	if (f == "") // if file string is empty, process data requests
 	{
-		handle_data_request(n, p, w, chan, chan_type, request_buffer);
+		handle_data_request(n, p, w, k, d, g, chan, chan_type, *request_buffer);
 	}
 	else
 	{
-		handle_file_request(f, m, w, chan, chan_type, request_buffer);
+		handle_file_request(f, m, z, w, chan, chan_type, *request_buffer);
 	}
 
     gettimeofday (&end, 0);
+	getrusage(RUSAGE_SELF, &usage_end);
 
 	timer_delete(t_id);
 
     int secs = (end.tv_sec * 1e6 + end.tv_usec - start.tv_sec * 1e6 - start.tv_usec)/(int) 1e6;
     int usecs = (int)(end.tv_sec * 1e6 + end.tv_usec - start.tv_sec * 1e6 - start.tv_usec)%((int) 1e6);
     cout << "Took " << secs << " seconds and " << usecs << " microseconds" << endl;
+	if (FILE_SIZE > 0)
+	{
+		double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+		printf("Transferred %.3f GB/s\n", FILE_SIZE / elapsed / 1e9);
+	}
+	cout << "Context switches: " << usage_end.ru_nvcsw - usage_start.ru_nvcsw << " voluntary, "
+		<< usage_end.ru_nivcsw - usage_start.ru_nivcsw << " involuntary" << endl;
 
     char* q = (char*) new quitmsg();
     chan->cwrite ( q, sizeof (quitmsg));
@@ -479,4 +699,5 @@ int main(int argc, char *argv[])
     cout << "All Done!!!" << endl;
 	delete q;
     delete chan;
+	delete request_buffer;
 }
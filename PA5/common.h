@@ -31,9 +31,11 @@ using namespace std;
 
 #define NUM_PERSONS 15  // number of person to collect data for
 #define MAX_MESSAGE 256  // maximum buffer size for each message
+#define MAX_PIPELINE 64  // maximum pipelined requests outstanding on one channel
+#define MAX_BULK_CHUNK (64 << 20)  // maximum file chunk of one bulk request (-m above MAX_MESSAGE)
 
 // different types of messages
-enum MESSAGE_TYPE {DATA_MSG, FILE_MSG, NEWCHANNEL_MSG, QUIT_MSG, UNKNOWN_MSG};  
+enum MESSAGE_TYPE {DATA_MSG, FILE_MSG, NEWCHANNEL_MSG, QUIT_MSG, PIPED_DATA_MSG, RANGE_DATA_MSG, FILE_BULK_MSG, FILE_SPLICE_MSG, UNKNOWN_MSG};  
 enum CHANNEL_TYPE {FIFO, MESSAGE_QUEUE, SHARED_MEMORY};  
 
 
@@ -49,6 +51,41 @@ public:
     }
 };
 
+// data request that may be answered out of order: the server replies with a pipedreply
+// carrying the same id, and several may be outstanding on one channel (up to MAX_PIPELINE)
+class pipedmsg{
+public:
+    MESSAGE_TYPE mtype;
+    unsigned int id;
+    datamsg request;
+
+    pipedmsg (unsigned int _id, datamsg _request) : request(_request){
+        mtype = PIPED_DATA_MSG, id = _id;
+    }
+};
+
+// reply to a pipedmsg
+class pipedreply{
+public:
+    unsigned int id;
+    double data;
+};
+
+// message requesting count consecutive data points (one every 0.004 s) starting at seconds;
+// the server answers with count packed doubles, which must fit the negotiated message size
+// (-m). Replies larger than MAX_MESSAGE come back as a cwrite_bulk payload
+class rangemsg{
+public:
+    MESSAGE_TYPE mtype;
+    int person;
+    double seconds;
+    int count;
+    int ecgno;
+    rangemsg (int _person, double _seconds, int _count, int _eno){
+        mtype = RANGE_DATA_MSG, person = _person, seconds = _seconds, count = _count, ecgno = _eno;
+    }
+};
+
 // message requesting a file
 class filemsg{
 public:
@@ -61,6 +98,29 @@ public:
     }
 };
 
+// message requesting a file chunk larger than MAX_MESSAGE (up to the negotiated -m and
+// MAX_BULK_CHUNK); the reply is the raw chunk, read with RequestChannel::cread_bulk.
+// Same layout as filemsg, and likewise followed by the NUL terminated file name
+class bulkfilemsg{
+public:
+    MESSAGE_TYPE mtype;
+    __int64_t offset;
+    int length;
+
+    bulkfilemsg (__int64_t _offset, int _length){
+        mtype = FILE_BULK_MSG, offset = _offset, length = _length;
+    }
+};
+
+// bulkfilemsg asking the server to move the chunk from the file into the channel with
+// RequestChannel::cwrite_file; the reply is read the same way (or with cread_file)
+class splicefilemsg : public bulkfilemsg{
+public:
+    splicefilemsg (__int64_t _offset, int _length) : bulkfilemsg(_offset, _length){
+        mtype = FILE_SPLICE_MSG;
+    }
+};
+
 // message requesting a new channel
 class newchannelmsg{
 public:
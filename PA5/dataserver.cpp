@@ -11,10 +11,15 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <vector>
+#include <map>
 #include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include "FIFORequestChannel.h"
 #include "MQRequestChannel.h"
 #include "SHMRequestChannel.h"
+#include "SlotBuffer.h"
+#include "ECGData.h"
 using namespace std;
 
 
@@ -23,7 +28,26 @@ pthread_mutex_t newchannel_lock;
 void *handle_process_loop(void *_channel);
 int bufsize = MAX_MESSAGE;
 CHANNEL_TYPE chan_type;
-vector<string> all_data [NUM_PERSONS];
+ecg_data all_data [NUM_PERSONS]; // every person's samples, mapped from the cache or parsed at startup
+
+struct mapped_file
+{ // a requested file, opened and mapped read-only the first time any channel asks for it
+	char* data; // NULL for an empty file
+	__int64_t size;
+	int fd; // kept open for splice requests
+};
+map<string, mapped_file> file_cache; // by path, kept for the lifetime of the server
+pthread_mutex_t file_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct pipeline
+{ // pipelined data requests of one channel, answered by up to MAX_PIPELINE threads
+	RequestChannel* channel;
+	SlotBuffer* requests; // pipedmsgs waiting for a thread
+	pthread_mutex_t write_lock; // replies are written by several threads
+	pthread_t threads[MAX_PIPELINE];
+	int nthreads;
+	int idle; // threads waiting for a request
+};
 
 
 void process_newchannel_request (RequestChannel *_channel)
@@ -57,31 +81,60 @@ void process_newchannel_request (RequestChannel *_channel)
 void populate_file_data (int person){
 	//cout << "populating for person " << person << endl;
 	string filename = "BIMDC/" + to_string(person) + ".csv";
-	char line[100];
-	ifstream ifs (filename.c_str());
-	int count = 0;
-	while (!ifs.eof()){
-		line[0] = 0;
-		ifs.getline(line, 100);
-		if (ifs.eof())
-			break;
-		double seconds = stod (split (string(line), ',')[0]);
-		if (line [0])
-			all_data [person-1].push_back(string(line));
+	if (!load_ecg_data (filename, all_data [person-1])){
+		EXITONERROR ("Cannot read " + filename);
 	}
 }
 
+bool map_file_data (){
+	// use the binary cache only if no csv changed after it was written
+	string cache = string ("BIMDC/") + ECG_CACHE_FILE;
+	struct stat cache_stat, csv_stat;
+	if (stat (cache.c_str(), &cache_stat) < 0)
+		return false;
+	for (int i=0; i<NUM_PERSONS; i++){
+		string filename = "BIMDC/" + to_string(i+1) + ".csv";
+		if (stat (filename.c_str(), &csv_stat) == 0 && (csv_stat.st_mtim.tv_sec > cache_stat.st_mtim.tv_sec
+			|| (csv_stat.st_mtim.tv_sec == cache_stat.st_mtim.tv_sec && csv_stat.st_mtim.tv_nsec > cache_stat.st_mtim.tv_nsec))){
+			cout << cache << " is older than " << filename << ", parsing the csv files (run ecgconvert to update it)" << endl;
+			return false;
+		}
+	}
+	return map_ecg_cache (cache, all_data);
+}
+
 double get_data_from_memory (int person, double seconds, int ecgno){
-	int index = (int)round (seconds / 0.004);
-	string line = all_data [person-1][index]; 
-	vector<string> parts = split (line, ',');
-	double sec = stod(parts [0]);
-	double ecg1 = stod (parts [1]);
-	double ecg2 = stod (parts [2]); 
-	if (ecgno == 1)
-		return ecg1;
-	else
-		return ecg2;
+	return ecg_value (all_data [person-1], ecg_index (seconds), ecgno);
+}
+
+mapped_file get_mapped_file (string filename){
+	pthread_mutex_lock(&file_cache_lock);
+	map<string, mapped_file>::iterator it = file_cache.find (filename);
+	if (it != file_cache.end()){
+		mapped_file f = it->second;
+		pthread_mutex_unlock(&file_cache_lock);
+		return f;
+	}
+
+	int fd = open (filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat (fd, &st) < 0){
+		EXITONERROR ("Cannot open " + filename);
+	}
+	mapped_file f;
+	f.size = st.st_size;
+	f.data = NULL;
+	if (f.size > 0){
+		f.data = (char*) mmap (NULL, f.size, PROT_READ, MAP_SHARED, fd, 0);
+		if (f.data == MAP_FAILED){
+			EXITONERROR ("Cannot map " + filename);
+		}
+		madvise (f.data, f.size, MADV_SEQUENTIAL);
+	}
+	f.fd = fd;
+	file_cache [filename] = f;
+	pthread_mutex_unlock(&file_cache_lock);
+	return f;
 }
 
 void process_file_request (RequestChannel* rc, char* request){
@@ -89,26 +142,28 @@ void process_file_request (RequestChannel* rc, char* request){
 	filemsg * f = (filemsg *) request;
 	string filename = request + sizeof (filemsg);
 	filename = "BIMDC/" + filename; // adding the path prefix to the requested file name
+	mapped_file file = get_mapped_file (filename);
 
 	if (f->offset == 0 && f->length == 0){ // means that the client is asking for file size
-		__int64_t fs = get_file_size (filename);
-		rc->cwrite ((char *)&fs, sizeof (__int64_t));
+		rc->cwrite ((char *)&file.size, sizeof (__int64_t));
 		return;
 	}
 	
-	// make sure that client is not requesting too big a chunk
+	// make sure that client is not requesting too big a chunk, or beyond the end of the file
 	assert (f->length <= bufsize);
+	assert (f->offset >= 0 && f->offset + f->length <= file.size);
 	
-	char buffer [bufsize];
-	FILE* fp = fopen (filename.c_str(), "rb");
-	if (!fp){
-		EXITONERROR ("Cannot open " + filename);
+	if (f->mtype == FILE_BULK_MSG){
+		assert (f->length <= MAX_BULK_CHUNK);
+		rc->cwrite_bulk (file.data + f->offset, f->length);
+	}
+	else if (f->mtype == FILE_SPLICE_MSG){ // the channel moves the bytes from the file itself
+		assert (f->length <= MAX_BULK_CHUNK);
+		rc->cwrite_file (file.fd, f->offset, f->length);
+	}
+	else{
+		rc->cwrite (file.data + f->offset, f->length); // straight from the mapping into the channel
 	}
-	fseek (fp, f->offset, SEEK_SET);
-	int nbytes = fread (buffer, 1, f->length, fp);
-	assert (nbytes == f->length);
-	rc->cwrite (buffer, nbytes);
-	fclose (fp);
 }
 
 void process_data_request (RequestChannel* rc, char* request){
@@ -117,11 +172,92 @@ void process_data_request (RequestChannel* rc, char* request){
 	rc->cwrite((char *) &data, sizeof (double));
 }
 
+void* pipeline_thread_function(void* arg)
+{ // answers pipelined requests of one channel until it pops an empty message
+	struct pipeline* pipe = (struct pipeline*) arg;
+	BufferSlot slot;
+
+	for (;;){
+		__atomic_fetch_add(&pipe->idle, 1, __ATOMIC_SEQ_CST);
+		pipe->requests->acquire(slot);
+		__atomic_fetch_sub(&pipe->idle, 1, __ATOMIC_SEQ_CST);
+		if (slot.len == 0){
+			pipe->requests->release(slot);
+			break;
+		}
+		pipedmsg request = *(pipedmsg*) slot.data;
+		pipe->requests->release(slot);
+
+		usleep (rand () % 5000);
+		pipedreply reply;
+		reply.id = request.id;
+		reply.data = get_data_from_memory (request.request.person, request.request.seconds, request.request.ecgno);
+
+		pthread_mutex_lock(&pipe->write_lock);
+		pipe->channel->cwrite((char *) &reply, sizeof (pipedreply));
+		pthread_mutex_unlock(&pipe->write_lock);
+	}
+	return NULL;
+}
+
+void process_piped_request(struct pipeline*& pipe, RequestChannel* rc, char* request){
+	if (pipe == NULL){ // first pipelined request on this channel
+		pipe = new pipeline;
+		pipe->channel = rc;
+		pipe->requests = new SlotBuffer(MAX_PIPELINE);
+		pthread_mutex_init(&pipe->write_lock, NULL);
+		pipe->nthreads = 0;
+		pipe->idle = 0;
+	}
+
+	// threads are added only while every existing one is busy, so a channel gets as many as it keeps in flight
+	if (__atomic_load_n(&pipe->idle, __ATOMIC_SEQ_CST) == 0 && pipe->nthreads < MAX_PIPELINE){
+		if (pthread_create(&pipe->threads[pipe->nthreads], NULL, pipeline_thread_function, pipe) != 0){
+			EXITONERROR("process_piped_request");
+		}
+		pipe->nthreads++;
+	}
+	pipe->requests->push(request, sizeof (pipedmsg));
+}
+
+void close_pipeline(struct pipeline* pipe){
+	for (int i = 0; i < pipe->nthreads; i++){
+		pipe->requests->push(NULL, 0);
+	}
+	for (int i = 0; i < pipe->nthreads; i++){
+		pthread_join(pipe->threads[i], NULL);
+	}
+	pthread_mutex_destroy(&pipe->write_lock);
+	delete pipe->requests;
+	delete pipe;
+}
+
 void process_unknown_request(RequestChannel *rc){
 	char a = 0;
 	rc->cwrite (&a, sizeof (a));
 }
 
+void process_range_request (RequestChannel* rc, char* request){
+	rangemsg* r = (rangemsg* ) request;
+	int first = ecg_index (r->seconds);
+
+	// make sure that client is asking for points that exist, and not too many of them
+	// (sizes are compared as size_t, so a huge count cannot wrap past the checks)
+	if (r->person < 1 || r->person > NUM_PERSONS || (r->ecgno != 1 && r->ecgno != 2) || r->count <= 0 || first < 0
+		|| (size_t) r->count * sizeof (double) > (size_t) bufsize
+		|| (size_t) first + (size_t) r->count > (size_t) all_data [r->person-1].count){
+		process_unknown_request (rc);
+		return;
+	}
+
+	// the points are contiguous in their column; replies too large for a message go out as a bulk payload
+	const double* column = (r->ecgno == 1) ? all_data [r->person-1].ecg1 : all_data [r->person-1].ecg2;
+	if (r->count * sizeof (double) > MAX_MESSAGE)
+		rc->cwrite_bulk((char *) (column + first), r->count * sizeof (double));
+	else
+		rc->cwrite((char *) (column + first), r->count * sizeof (double));
+}
+
 
 int process_request(RequestChannel *rc, char* _request)
 {
@@ -130,7 +266,11 @@ int process_request(RequestChannel *rc, char* _request)
 		usleep (rand () % 5000);
 		process_data_request (rc, _request);
 	}
-	else if (m == FILE_MSG){
+	else if (m == RANGE_DATA_MSG){
+		usleep (rand () % 5000);
+		process_range_request (rc, _request);
+	}
+	else if (m == FILE_MSG || m == FILE_BULK_MSG || m == FILE_SPLICE_MSG){
 		process_file_request (rc, _request);
 			
 	}else if (m == NEWCHANNEL_MSG){
@@ -139,6 +279,7 @@ int process_request(RequestChannel *rc, char* _request)
 	else{
 		process_unknown_request(rc);
 	}
+	return 0;
 }
 
 void* handle_process_loop(void* _channel)
@@ -157,17 +298,23 @@ void* handle_process_loop(void* _channel)
 			break;		
 	}
 
+	struct pipeline* pipe = NULL; // created by the first pipelined request
 	for (;;){
 		int len = 0;
-		char* buffer = channel->cread(&len);
-		if (len == 0)
+		char* buffer = channel->cacquire(&len); // the request is only needed until its reply is written
+		if (len == 0 || *(MESSAGE_TYPE *) buffer == QUIT_MSG){
+			channel->crelease(buffer);
 			break;
-		MESSAGE_TYPE m = *(MESSAGE_TYPE *) buffer;
-		if (m == QUIT_MSG)
-			break;
-		process_request(channel, buffer);
-		delete[] buffer;
+		}
+		if (*(MESSAGE_TYPE *) buffer == PIPED_DATA_MSG)
+			process_piped_request(pipe, channel, buffer);
+		else
+			process_request(channel, buffer);
+		channel->crelease(buffer);
 	}
+	if (pipe != NULL)
+		close_pipeline(pipe);
+	return NULL;
 }
 
 /*--------------------------------------------------------------------------*/
@@ -176,12 +323,18 @@ void* handle_process_loop(void* _channel)
 
 int main(int argc, char *argv[])
 {
+	if (argc < 3){ // the client passes both when it starts the server
+		cout << "usage: dataserver <message size> <channel type>" << endl;
+		exit (EXIT_FAILURE);
+	}
 	srand(time_t(NULL));
 	bufsize = atoi(argv[1]); // modify this to accept bufsize m from the client side
 	chan_type = (CHANNEL_TYPE) atoi(argv[2]);
 
-	for (int i=0; i<NUM_PERSONS; i++){
-		populate_file_data(i+1);
+	if (!map_file_data()){
+		for (int i=0; i<NUM_PERSONS; i++){
+			populate_file_data(i+1);
+		}
 	}
 	
 	RequestChannel* control_channel;